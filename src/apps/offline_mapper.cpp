@@ -0,0 +1,306 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+
+#include <ros/time.h>
+#include <rosbag/bag.h>
+#include <rosbag/view.h>
+#include <message_filters/simple_filter.h>
+#include <message_filters/synchronizer.h>
+#include <message_filters/sync_policies/approximate_time.h>
+#include <lucrezio_simulation_environments/LogicalImage.h>
+
+#include <pcl_ros/point_cloud.h>
+#include <pcl/io/pcd_io.h>
+
+#include <object_detector/object_detector.h>
+#include <semantic_mapper/semantic_mapper.h>
+#include <utils/utils.h>
+#include <utils/conversions.h>
+
+//replays recorded logical image and depth cloud pairs through the mapping pipeline
+//without a ros master, as fast as the cpu allows
+
+typedef lucrezio_simulation_environments::LogicalImage LogicalImage;
+
+//feeds messages read from a bag into a message_filters synchronizer
+template <class M>
+class BagSubscriber : public message_filters::SimpleFilter<M>{
+  public:
+    void newMessage(const boost::shared_ptr<M const> &msg){
+      this->signalMessage(msg);
+    }
+};
+
+struct StageTimes{
+  StageTimes():conversion(0),detection(0),extraction(0),association(0),merge(0),total(0),frames(0){}
+  double conversion;
+  double detection;
+  double extraction;
+  double association;
+  double merge;
+  double total;
+  int frames;
+};
+
+std::mutex output_mutex;
+
+class OfflineMapper{
+  public:
+    OfflineMapper(const ClassRegistry &registry,
+                  const ResolutionPolicy &resolution_policy,
+                  const std::string &logical_image_topic,
+                  const std::string &depth_points_topic):
+      _logical_image_topic(logical_image_topic),
+      _depth_points_topic(depth_points_topic),
+      _synchronizer(FilterSyncPolicy(1000),_logical_image_sub,_depth_points_sub){
+
+      _detector.registry() = registry;
+      _mapper.resolutionPolicy() = resolution_policy;
+
+      _synchronizer.registerCallback(boost::bind(&OfflineMapper::filterCallback, this, _1, _2));
+
+      _camera_offset.setIdentity();
+      _camera_offset.linear() = Eigen::Quaternionf(0.5,-0.5,0.5,-0.5).toRotationMatrix();
+    }
+
+    //process all the synchronized frames of a bag
+    void run(const std::string &bag_filename){
+      rosbag::Bag bag;
+      bag.open(bag_filename,rosbag::bagmode::Read);
+
+      std::vector<std::string> topics;
+      topics.push_back(_logical_image_topic);
+      topics.push_back(_depth_points_topic);
+      rosbag::View view(bag,rosbag::TopicQuery(topics));
+
+      double start = getTime();
+      for(const rosbag::MessageInstance &m : view){
+        if(m.getTopic() == _logical_image_topic){
+          LogicalImage::ConstPtr logical_image_msg = m.instantiate<LogicalImage>();
+          if(logical_image_msg)
+            _logical_image_sub.newMessage(logical_image_msg);
+        }
+        if(m.getTopic() == _depth_points_topic){
+          PointCloud::ConstPtr depth_points_msg = m.instantiate<PointCloud>();
+          if(depth_points_msg)
+            _depth_points_sub.newMessage(depth_points_msg);
+        }
+      }
+      _times.total = getTime()-start;
+
+      bag.close();
+    }
+
+    //write object clouds and octrees in the output folder
+    void saveMap(const std::string &prefix){
+      const ObjectPtrVector *global_map = _mapper.globalMap();
+      for(size_t i=0; i<global_map->size(); ++i){
+        const ObjectPtr &obj = global_map->at(i);
+        if(obj->numPoints())
+          pcl::io::savePCDFileBinary(prefix+obj->model()+".pcd",*(obj->fullCloud()));
+        obj->octree()->writeBinaryConst(prefix+obj->model()+".bt");
+      }
+    }
+
+    inline const StageTimes &times() const {return _times;}
+    inline size_t numObjects() const {return _mapper.globalMap()->size();}
+
+  protected:
+
+    void filterCallback(const LogicalImage::ConstPtr &logical_image_msg,
+                        const PointCloud::ConstPtr &depth_points_msg){
+
+      //check that the there's at list one object in the robot field-of-view
+      if(logical_image_msg->models.empty())
+        return;
+
+      double t0 = getTime();
+
+      //get camera pose
+      Eigen::Isometry3f camera_transform = poseMsg2eigen(logical_image_msg->pose);
+
+      //get models
+      logicalImageToModels(logical_image_msg,_detector.registry(),_models);
+
+      //get point cloud
+      PointCloud::Ptr transformed_cloud (new PointCloud ());
+      pcl::transformPointCloud (*depth_points_msg, *transformed_cloud, camera_transform*_camera_offset);
+      double t1 = getTime();
+
+      //compute detections
+      _detector.setCameraTransform(camera_transform);
+      _detector.setModels(_models);
+      _detector.setInputCloud(transformed_cloud);
+      _detector.setupDetections();
+      _detector.compute();
+      double t2 = getTime();
+
+      //extract objects from detections
+      _mapper.setGlobalT(camera_transform);
+      _mapper.extractObjects(_detector.detections(),depth_points_msg);
+      double t3 = getTime();
+
+      //data association
+      _mapper.findAssociations();
+      double t4 = getTime();
+
+      //update
+      _mapper.mergeMaps();
+      double t5 = getTime();
+
+      _times.conversion += t1-t0;
+      _times.detection += t2-t1;
+      _times.extraction += t3-t2;
+      _times.association += t4-t3;
+      _times.merge += t5-t4;
+      _times.frames++;
+    }
+
+    std::string _logical_image_topic;
+    std::string _depth_points_topic;
+
+    BagSubscriber<LogicalImage> _logical_image_sub;
+    BagSubscriber<PointCloud> _depth_points_sub;
+    typedef message_filters::sync_policies::ApproximateTime<LogicalImage,PointCloud> FilterSyncPolicy;
+    message_filters::Synchronizer<FilterSyncPolicy> _synchronizer;
+
+    Eigen::Isometry3f _camera_offset;
+    ModelVector _models;
+
+    //computing modules
+    ObjectDetector _detector;
+    SemanticMapper _mapper;
+
+    StageTimes _times;
+};
+
+void printTimes(const std::string &bag_filename, const StageTimes &times, size_t num_objects){
+  const int frames = std::max(times.frames,1);
+  std::lock_guard<std::mutex> lock(output_mutex);
+  std::cerr << bag_filename << ": " << times.frames << " frames in " << times.total << " s ("
+            << times.frames/std::max(times.total,1e-9) << " frames/s), "
+            << num_objects << " objects" << std::endl;
+  std::cerr << "\tconversion:  " << 1e3*times.conversion/frames << " ms/frame" << std::endl;
+  std::cerr << "\tdetection:   " << 1e3*times.detection/frames << " ms/frame" << std::endl;
+  std::cerr << "\textraction:  " << 1e3*times.extraction/frames << " ms/frame" << std::endl;
+  std::cerr << "\tassociation: " << 1e3*times.association/frames << " ms/frame" << std::endl;
+  std::cerr << "\tmerge:       " << 1e3*times.merge/frames << " ms/frame" << std::endl;
+}
+
+std::string bagStem(const std::string &bag_filename){
+  size_t slash = bag_filename.find_last_of('/');
+  std::string stem = (slash == std::string::npos) ? bag_filename : bag_filename.substr(slash+1);
+  size_t dot = stem.find_last_of('.');
+  return (dot == std::string::npos) ? stem : stem.substr(0,dot);
+}
+
+const char* banner[] = {
+  "offline_mapper: builds semantic maps from recorded bags, one map per bag",
+  "usage: offline_mapper [options] <bag> [<bag> ...]",
+  "-e <environment>    environment in lucrezio_simulation_environments (default: garage)",
+  "-j <jobs>           number of bags processed in parallel (default: 1)",
+  "-o <folder>         folder where object clouds and octrees are written",
+  "-logical <topic>    logical image topic (default: /gazebo/logical_camera_image)",
+  "-depth <topic>      depth cloud topic (default: /camera/depth/points)",
+  "-dense               dense voxel grids instead of octrees for the object occupancy",
+  "-voxels <n>         octree resolution from the object box, spanning about n voxels (default: 0, fixed 5cm)",
+  0
+};
+
+void printBanner(){
+  for(int i=0; banner[i]; ++i)
+    std::cerr << banner[i] << std::endl;
+}
+
+int main(int argc, char **argv){
+
+  std::string environment = "garage";
+  std::string output_folder = "";
+  std::string logical_image_topic = "/gazebo/logical_camera_image";
+  std::string depth_points_topic = "/camera/depth/points";
+  int jobs = 1;
+  int target_voxels = 0;
+  bool dense_grid = false;
+  std::vector<std::string> bag_filenames;
+
+  int c=1;
+  while(c<argc){
+    std::string arg(argv[c]);
+    if(arg == "-h"){
+      printBanner();
+      return 0;
+    } else if(arg == "-e" && c+1<argc){
+      environment = argv[++c];
+    } else if(arg == "-j" && c+1<argc){
+      jobs = std::max(1,atoi(argv[++c]));
+    } else if(arg == "-o" && c+1<argc){
+      output_folder = argv[++c];
+      if(output_folder.back() != '/')
+        output_folder += "/";
+    } else if(arg == "-logical" && c+1<argc){
+      logical_image_topic = argv[++c];
+    } else if(arg == "-depth" && c+1<argc){
+      depth_points_topic = argv[++c];
+    } else if(arg == "-dense"){
+      dense_grid = true;
+    } else if(arg == "-voxels" && c+1<argc){
+      target_voxels = std::max(0,atoi(argv[++c]));
+    } else {
+      bag_filenames.push_back(arg);
+    }
+    c++;
+  }
+
+  if(bag_filenames.empty()){
+    printBanner();
+    return 1;
+  }
+
+  ros::Time::init();
+
+  //class ids are shared by all the jobs
+  ObjectDetector detector;
+  detector.environment() = environment;
+  detector.setupModelColors();
+  const ClassRegistry &registry = detector.registry();
+
+  ResolutionPolicy resolution_policy;
+  resolution_policy.setTargetVoxels(target_voxels);
+  resolution_policy.setDenseGrid(dense_grid);
+
+  std::atomic<size_t> next_bag(0);
+  std::atomic<int> failures(0);
+  double start = getTime();
+
+  auto worker = [&](){
+    for(size_t i=next_bag++; i<bag_filenames.size(); i=next_bag++){
+      const std::string &bag_filename = bag_filenames[i];
+      try{
+        OfflineMapper mapper(registry,resolution_policy,logical_image_topic,depth_points_topic);
+        mapper.run(bag_filename);
+        printTimes(bag_filename,mapper.times(),mapper.numObjects());
+        if(!output_folder.empty())
+          mapper.saveMap(output_folder+bagStem(bag_filename)+"_");
+      } catch(const std::exception &e){
+        std::lock_guard<std::mutex> lock(output_mutex);
+        std::cerr << bag_filename << ": " << e.what() << std::endl;
+        failures++;
+      }
+    }
+  };
+
+  std::vector<std::thread> workers;
+  const int num_workers = std::min<int>(jobs,bag_filenames.size());
+  for(int i=0; i<num_workers; ++i)
+    workers.push_back(std::thread(worker));
+  for(std::thread &t : workers)
+    t.join();
+
+  std::cerr << "processed " << bag_filenames.size() << " bags in " << getTime()-start << " s" << std::endl;
+
+  return failures ? 1 : 0;
+}
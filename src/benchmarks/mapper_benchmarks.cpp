@@ -0,0 +1,556 @@
+#include <memory>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <cstdlib>
+#include <atomic>
+#include <cerrno>
+
+#include <benchmark/benchmark.h>
+
+#include <object_detector/object_detector.h>
+#include <semantic_mapper/semantic_mapper.h>
+#include <semantic_mapper/map_index.h>
+#include <semantic_mapper/quantized_cloud.h>
+
+#include "synthetic_scene.h"
+
+//microbenchmarks for the core kernels on synthetic data, no ros runtime is needed.
+//machine-readable results: mapper_benchmarks --benchmark_out=results.json --benchmark_out_format=json
+
+//heap allocations of the whole process. The allocator is replaced at the malloc level (glibc),
+//so operator new, Eigen's aligned_allocator and EIGEN_MAKE_ALIGNED_OPERATOR_NEW are all counted
+static std::atomic<size_t> heap_allocations(0);
+
+extern "C" {
+  void *__libc_malloc(size_t size);
+  void *__libc_calloc(size_t count, size_t size);
+  void *__libc_realloc(void *p, size_t size);
+  void *__libc_memalign(size_t alignment, size_t size);
+  void __libc_free(void *p);
+
+  void *malloc(size_t size){
+    heap_allocations++;
+    return __libc_malloc(size);
+  }
+
+  void *calloc(size_t count, size_t size){
+    heap_allocations++;
+    return __libc_calloc(count,size);
+  }
+
+  //a reallocation counts as an allocation (it usually moves the block)
+  void *realloc(void *p, size_t size){
+    heap_allocations++;
+    return __libc_realloc(p,size);
+  }
+
+  void *memalign(size_t alignment, size_t size){
+    heap_allocations++;
+    return __libc_memalign(alignment,size);
+  }
+
+  void *aligned_alloc(size_t alignment, size_t size){
+    heap_allocations++;
+    return __libc_memalign(alignment,size);
+  }
+
+  int posix_memalign(void **p, size_t alignment, size_t size){
+    if(alignment % sizeof(void*) || (alignment & (alignment-1)))
+      return EINVAL;
+    heap_allocations++;
+    *p = __libc_memalign(alignment,size);
+    return *p || !size ? 0 : ENOMEM;
+  }
+
+  void free(void *p){
+    __libc_free(p);
+  }
+}
+
+namespace {
+
+  //the mapper owns (and recycles) the local objects only once mergeMaps consumed them
+  void deleteLocalMap(const SemanticMapper &mapper){
+    const ObjectPtrVector *local_map = mapper.localMap();
+    for(size_t i=0; i<local_map->size(); ++i)
+      delete local_map->at(i);
+  }
+
+  float boxVolume(const Eigen::Vector3f &min, const Eigen::Vector3f &max){
+    Eigen::Vector3f size = (max-min).cwiseMax(Eigen::Vector3f::Zero());
+    return size.x()*size.y()*size.z();
+  }
+
+  //the thread index is a member function in recent versions of google benchmark, a field before
+  template<class State> auto threadIndex(const State &state, int) -> decltype(state.thread_index()){
+    return state.thread_index();
+  }
+  template<class State> int threadIndex(const State &state, long){
+    return state.thread_index;
+  }
+
+  void runDetector(ObjectDetector &detector, const SyntheticScene &scene){
+    detector.setCameraTransform(scene.cameraTransform());
+    detector.setModels(scene.models());
+    detector.setInputCloud(scene.worldCloud());
+    detector.setupDetections();
+    detector.compute();
+  }
+
+}
+
+//args: image width, number of models
+static void BM_ObjectDetectorCompute(benchmark::State &state){
+  const int width = state.range(0);
+  SyntheticScene scene(width,width*3/4,state.range(1));
+  ObjectDetector detector;
+
+  for(auto _ : state){
+    runDetector(detector,scene);
+    benchmark::DoNotOptimize(detector.detections().data());
+  }
+  state.SetItemsProcessed(state.iterations()*scene.worldCloud()->size());
+  state.counters["models"] = state.range(1);
+}
+BENCHMARK(BM_ObjectDetectorCompute)
+->ArgsProduct({{160,320,640},{1,4,16}})
+->Unit(benchmark::kMillisecond);
+
+//args: image width, number of models
+static void BM_ExtractObjects(benchmark::State &state){
+  const int width = state.range(0);
+  SyntheticScene scene(width,width*3/4,state.range(1));
+  ObjectDetector detector;
+  runDetector(detector,scene);
+
+  SemanticMapper mapper;
+  mapper.setGlobalT(scene.cameraTransform());
+
+  //the first call populates the global map
+  mapper.extractObjects(detector.detections(),scene.cameraCloud());
+
+  size_t points = 0;
+  for(const Detection &detection : detector.detections())
+    points += detection.pixels().size();
+
+  for(auto _ : state){
+    mapper.extractObjects(detector.detections(),scene.cameraCloud());
+
+    //the merged local objects and their clouds are recycled by the next extraction
+    state.PauseTiming();
+    mapper.findAssociations();
+    mapper.mergeMaps();
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(state.iterations()*points);
+  state.counters["objects"] = mapper.globalMap()->size();
+}
+BENCHMARK(BM_ExtractObjects)
+->ArgsProduct({{160,320,640},{1,4,16}})
+->Unit(benchmark::kMillisecond);
+
+//args: number of models
+static void BM_FindAssociations(benchmark::State &state){
+  SyntheticScene scene(160,120,state.range(0));
+  ObjectDetector detector;
+  runDetector(detector,scene);
+
+  SemanticMapper mapper;
+  mapper.setGlobalT(scene.cameraTransform());
+  mapper.extractObjects(detector.detections(),scene.cameraCloud());
+  mapper.extractObjects(detector.detections(),scene.cameraCloud());
+
+  for(auto _ : state){
+    mapper.findAssociations();
+    benchmark::DoNotOptimize(mapper.associations().size());
+  }
+  state.counters["global_objects"] = mapper.globalMap()->size();
+  state.counters["local_objects"] = mapper.localMap()->size();
+  deleteLocalMap(mapper);
+}
+BENCHMARK(BM_FindAssociations)
+->Arg(1)->Arg(4)->Arg(16)->Arg(64)->Arg(256);
+
+//args: number of points in each object cloud
+static void BM_ObjectMerge(benchmark::State &state){
+  const int num_points = state.range(0);
+  const Eigen::Vector3f center(2,0,0.5);
+  const Eigen::Vector3f size(0.5,0.5,0.8);
+  PointCloud::Ptr global_cloud = makeBoxCloud(num_points,center,size,1);
+  PointCloud::Ptr local_cloud = makeBoxCloud(num_points,center+Eigen::Vector3f(0.02,0,0),size,2);
+
+  Object local("box",center,center-size/2,center+size/2,Eigen::Vector3f::Ones(),local_cloud);
+  Object global("box",center,center-size/2,center+size/2,Eigen::Vector3f::Ones(),PointCloud::Ptr(new PointCloud()));
+
+  for(auto _ : state){
+    state.PauseTiming();
+    global.setCloud(global_cloud);
+    state.ResumeTiming();
+
+    global.merge(&local);
+    benchmark::DoNotOptimize(global.numPoints());
+  }
+  state.SetItemsProcessed(state.iterations()*2*num_points);
+  state.counters["merged_points"] = global.numPoints();
+  state.counters["cloud_bytes_per_point"] = (double)global.memoryUsage().cloud/std::max<size_t>(global.numPoints(),1);
+}
+BENCHMARK(BM_ObjectMerge)
+->RangeMultiplier(4)->Range(256,65536)
+->Unit(benchmark::kMillisecond);
+
+//every iteration encodes the cloud decoded by the previous one (what repeated merges and compactions do),
+//args: number of points, distance of the cloud from the map origin in m, extent of the cloud in m
+static void BM_QuantizedRoundTrip(benchmark::State &state){
+  const Eigen::Vector3f center(state.range(1),0,0.5);
+  const float extent = state.range(2);
+  PointCloud::Ptr original = makeBoxCloud(state.range(0),center,Eigen::Vector3f(extent,0.5,0.8),1);
+  PointCloud cloud = *original;
+  QuantizedCloud quantized;
+
+  bool lossless = true;
+  int round_trips = 0;
+  for(auto _ : state){
+    quantized.encode(cloud,0.001f);
+    PointCloud decoded;
+    quantized.decode(decoded);
+
+    //after the first round trip the points are on the grid and must stay there
+    if(round_trips++)
+      for(size_t i=0; i<cloud.size() && lossless; ++i)
+        lossless = decoded.points[i].getVector3fMap() == cloud.points[i].getVector3fMap();
+    cloud = decoded;
+  }
+
+  //the drift from the original is bounded by half a step (plus the float rounding of the coordinates)
+  float drift = 0;
+  for(size_t i=0; i<cloud.size(); ++i)
+    drift = std::max(drift,(cloud.points[i].getVector3fMap()-original->points[i].getVector3fMap()).cwiseAbs().maxCoeff());
+  const float bound = quantized.step()/2+(center.norm()+extent)*4*std::numeric_limits<float>::epsilon();
+  if(!lossless)
+    state.SkipWithError("re-encoding a quantized cloud is not lossless");
+  else if(drift > bound)
+    state.SkipWithError("quantization drift exceeds half a step");
+
+  state.SetItemsProcessed(state.iterations()*cloud.size());
+  state.counters["step_mm"] = quantized.step()*1000;
+  state.counters["drift_over_step"] = drift/quantized.step();
+}
+BENCHMARK(BM_QuantizedRoundTrip)
+->ArgsProduct({{4096},{0,100,1000},{1,200}});
+
+//args: number of points in the object cloud, octree resolution in mm
+static void BM_ObjectUpdateOccupancy(benchmark::State &state){
+  const int num_points = state.range(0);
+  const double resolution = state.range(1)*1e-3;
+  const Eigen::Vector3f center(2,0,0.5);
+  const Eigen::Vector3f size(0.5,0.5,0.8);
+  PointCloud::Ptr cloud = makeBoxCloud(num_points,center,size,1);
+  Eigen::Isometry3f T = Eigen::Isometry3f::Identity();
+
+  size_t octree_nodes = 0;
+  std::unique_ptr<Object> object;
+  for(auto _ : state){
+    state.PauseTiming();
+    object.reset(new Object("box",center,center-size/2,center+size/2,Eigen::Vector3f::Ones(),cloud));
+    object->setResolution(resolution,object->leafSize());
+    state.ResumeTiming();
+
+    object->updateOccupancy(T,cloud);
+
+    state.PauseTiming();
+    octree_nodes = object->octree()->size();
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(state.iterations()*num_points);
+  state.counters["octree_nodes"] = octree_nodes;
+}
+BENCHMARK(BM_ObjectUpdateOccupancy)
+->ArgsProduct({{1024,4096,16384},{20,50,100}})
+->Unit(benchmark::kMillisecond);
+
+//args: extraction stride. Reports the loss w.r.t. stride 1 on object clouds, boxes and volumes
+static void BM_ExtractionStride(benchmark::State &state){
+  SyntheticScene scene(640,480,4);
+  ObjectDetector detector;
+  runDetector(detector,scene);
+
+  //reference map at full resolution
+  SemanticMapper reference;
+  reference.setGlobalT(scene.cameraTransform());
+  reference.extractObjects(detector.detections(),scene.cameraCloud());
+  reference.mergeMaps();
+
+  std::unique_ptr<SemanticMapper> mapper;
+  for(auto _ : state){
+    state.PauseTiming();
+    mapper.reset(new SemanticMapper());
+    mapper->setGlobalT(scene.cameraTransform());
+    mapper->sampler().setStride(state.range(0));
+    state.ResumeTiming();
+
+    mapper->extractObjects(detector.detections(),scene.cameraCloud());
+    mapper->mergeMaps();
+  }
+
+  const ObjectPtrVector *reference_map = reference.globalMap();
+  const ObjectPtrVector *global_map = mapper->globalMap();
+  float points_ratio = 0, box_iou = 0, volume_error = 0;
+  int compared = 0;
+  for(size_t i=0; i<reference_map->size() && i<global_map->size(); ++i){
+    const ObjectPtr &ref = reference_map->at(i);
+    const ObjectPtr &obj = global_map->at(i);
+    points_ratio += (float)obj->numPoints()/ref->numPoints();
+    float intersection = boxVolume(ref->min().cwiseMax(obj->min()),ref->max().cwiseMin(obj->max()));
+    float union_volume = boxVolume(ref->min(),ref->max())+boxVolume(obj->min(),obj->max())-intersection;
+    box_iou += union_volume > 0 ? intersection/union_volume : 1.0f;
+    if(ref->ocupancy_volume() > 0)
+      volume_error += std::abs(obj->ocupancy_volume()-ref->ocupancy_volume())/ref->ocupancy_volume();
+    compared++;
+  }
+  compared = std::max(compared,1);
+  state.counters["objects"] = global_map->size();
+  state.counters["points_ratio"] = points_ratio/compared;
+  state.counters["box_iou"] = box_iou/compared;
+  state.counters["volume_rel_error"] = volume_error/compared;
+}
+BENCHMARK(BM_ExtractionStride)
+->Arg(1)->Arg(2)->Arg(4)->Arg(8)
+->Unit(benchmark::kMillisecond);
+
+//occupancy cost and memory of fixed vs box-driven resolution,
+//args: object (0: mug, 1: chair, 2: wardrobe), policy (0: fixed 5cm, 1: 4096 voxels per box)
+static void BM_ResolutionPolicy(benchmark::State &state){
+  const Eigen::Vector3f sizes[] = {Eigen::Vector3f(0.1,0.1,0.12),Eigen::Vector3f(0.5,0.5,0.8),Eigen::Vector3f(1.0,0.6,2.0)};
+  const Eigen::Vector3f size = sizes[state.range(0)];
+  const Eigen::Vector3f center(2,0,size.z()/2);
+  PointCloud::Ptr cloud = makeBoxCloud(4096,center,size,1);
+  Eigen::Isometry3f T = Eigen::Isometry3f::Identity();
+
+  ResolutionPolicy policy;
+  if(state.range(1))
+    policy.setTargetVoxels(4096);
+
+  std::unique_ptr<Object> object;
+  for(auto _ : state){
+    state.PauseTiming();
+    object.reset(new Object("box",center,center-size/2,center+size/2,Eigen::Vector3f::Ones(),cloud));
+    policy.apply(*object);
+    state.ResumeTiming();
+
+    object->updateOccupancy(T,cloud);
+  }
+
+  Object merged("box",center,center-size/2,center+size/2,Eigen::Vector3f::Ones(),PointCloud::Ptr(new PointCloud()));
+  policy.apply(merged);
+  merged.merge(object.get());
+
+  state.counters["resolution_mm"] = object->octree()->getResolution()*1e3;
+  state.counters["octree_nodes"] = object->octree()->size();
+  state.counters["octree_bytes"] = object->octree()->memoryUsage();
+  state.counters["occupied_volume_ratio"] = object->ocupancy_volume()/size.prod();
+  state.counters["merged_points"] = merged.numPoints();
+}
+BENCHMARK(BM_ResolutionPolicy)
+->ArgsProduct({{0,1,2},{0,1}})
+->Unit(benchmark::kMillisecond);
+
+//octree vs dense grid occupancy backend, the grid results are compared with the octree ones,
+//args: object (0: mug, 1: chair, 2: wardrobe), backend (0: octree, 1: dense grid)
+static void BM_OccupancyBackend(benchmark::State &state){
+  const Eigen::Vector3f sizes[] = {Eigen::Vector3f(0.1,0.1,0.12),Eigen::Vector3f(0.5,0.5,0.8),Eigen::Vector3f(1.0,0.6,2.0)};
+  const Eigen::Vector3f size = sizes[state.range(0)];
+  const Eigen::Vector3f center(2,0,size.z()/2);
+  PointCloud::Ptr cloud = makeBoxCloud(4096,center,size,1);
+  Eigen::Isometry3f T = Eigen::Isometry3f::Identity();
+
+  auto makeObject = [&](bool dense){
+    std::unique_ptr<Object> object(new Object("box",center,center-size/2,center+size/2,Eigen::Vector3f::Ones(),cloud));
+    if(dense)
+      object->useDenseGrid();
+    return object;
+  };
+
+  std::unique_ptr<Object> object;
+  for(auto _ : state){
+    state.PauseTiming();
+    object = makeObject(state.range(1));
+    state.ResumeTiming();
+
+    object->updateOccupancy(T,cloud);
+  }
+
+  std::unique_ptr<Object> reference = makeObject(false);
+  reference->updateOccupancy(T,cloud);
+  state.counters["occupied_voxels"] = object->numOccupiedVoxels();
+  state.counters["free_voxels"] = object->numFreeVoxels();
+  state.counters["volume_vs_octree"] = reference->ocupancy_volume() > 0 ? object->ocupancy_volume()/reference->ocupancy_volume() : 0;
+  state.counters["free_vs_octree"] = reference->numFreeVoxels() ? (double)object->numFreeVoxels()/reference->numFreeVoxels() : 0;
+  state.counters["bytes"] = object->grid() ? object->grid()->memoryUsage() : object->octree()->memoryUsage();
+}
+BENCHMARK(BM_OccupancyBackend)
+->ArgsProduct({{0,1,2},{0,1}})
+->Unit(benchmark::kMillisecond);
+
+//one camera per thread feeding a shared global map, args: number of models
+static void BM_MultiCameraFrame(benchmark::State &state){
+  static GlobalMapPtr global_map;
+  if(threadIndex(state,0) == 0){
+    global_map.reset(new GlobalMap());
+    global_map->occupancyScheduler().setViewGate(0.05,0.05,4);
+  }
+
+  SyntheticScene scene(160,120,state.range(0));
+  ObjectDetector detector;
+  runDetector(detector,scene);
+
+  //the shared map exists once all the threads are running
+  std::unique_ptr<SemanticMapper> mapper;
+
+  for(auto _ : state){
+    if(!mapper){
+      mapper.reset(new SemanticMapper(global_map));
+      mapper->setGlobalT(scene.cameraTransform());
+      mapper->setOccupancyBudget(0);
+    }
+
+    mapper->extractObjects(detector.detections(),scene.cameraCloud());
+    mapper->findAssociations();
+    mapper->mergeMaps();
+  }
+  state.SetItemsProcessed(state.iterations());
+  if(threadIndex(state,0) == 0)
+    state.counters["global_objects"] = global_map->objects()->size();
+}
+BENCHMARK(BM_MultiCameraFrame)
+->Arg(16)->Arg(64)
+->Threads(1)->Threads(2)->Threads(3)->Threads(4)
+->UseRealTime();
+
+//heap allocations of a steady-state frame (detection, extraction, association and merge of a
+//static scene whose occupancy updates are skipped by the view gate), args: number of models
+static void BM_FrameAllocations(benchmark::State &state){
+  SyntheticScene scene(160,120,state.range(0));
+  ObjectDetector detector;
+  SemanticMapper mapper;
+  mapper.setGlobalT(scene.cameraTransform());
+  mapper.setOccupancyBudget(-1);
+  mapper.occupancyScheduler().setViewGate(0.05,0.05,4);
+
+  //the first frames populate the map and the buffers
+  for(int i=0; i<3; ++i){
+    runDetector(detector,scene);
+    mapper.extractObjects(detector.detections(),scene.cameraCloud());
+    mapper.findAssociations();
+    mapper.mergeMaps();
+  }
+
+  size_t allocations = 0;
+  const size_t cloud_allocations = mapper.cloudPool().allocations();
+  for(auto _ : state){
+    const size_t before = heap_allocations;
+    runDetector(detector,scene);
+    mapper.extractObjects(detector.detections(),scene.cameraCloud());
+    mapper.findAssociations();
+    mapper.mergeMaps();
+    allocations += heap_allocations-before;
+  }
+  //the same objects are observed every frame, their clouds must all come from the pool
+  if(mapper.cloudPool().allocations() != cloud_allocations)
+    state.SkipWithError("the cloud pool allocated clouds in the steady state");
+
+  state.counters["allocations_per_frame"] = (double)allocations/state.iterations();
+  state.counters["objects"] = mapper.globalMap()->size();
+}
+BENCHMARK(BM_FrameAllocations)
+->Arg(4)->Arg(16)
+->Unit(benchmark::kMillisecond);
+
+//args: number of objects, threads (1: serial). Every frame merges all the objects and updates their occupancy
+static void BM_ParallelFrame(benchmark::State &state){
+  SyntheticScene scene(320,240,state.range(0));
+  ObjectDetector detector;
+  SemanticMapper mapper;
+  if(state.range(1) > 1)
+    mapper.setThreadPool(ThreadPoolPtr(new ThreadPool(state.range(1))));
+  mapper.setGlobalT(scene.cameraTransform());
+  mapper.setOccupancyBudget(-1);
+  mapper.occupancyScheduler().setViewGate(0,0,1);
+
+  runDetector(detector,scene);
+  mapper.extractObjects(detector.detections(),scene.cameraCloud());
+  mapper.mergeMaps();
+
+  for(auto _ : state){
+    runDetector(detector,scene);
+    mapper.extractObjects(detector.detections(),scene.cameraCloud());
+    mapper.findAssociations();
+    mapper.mergeMaps();
+  }
+  state.counters["objects"] = mapper.globalMap()->size();
+}
+BENCHMARK(BM_ParallelFrame)
+->Args({16,1})->Args({16,2})->Args({16,4})->Args({16,8})
+->Unit(benchmark::kMillisecond)
+->UseRealTime();
+
+//map snapshot of num_objects boxes of 10 classes on a 1m grid, each with an occupied voxel in its center
+static MapViewConstPtr makeGridView(int num_objects){
+  std::shared_ptr<MapView> view(new MapView());
+  const int side = std::ceil(std::sqrt((float)num_objects));
+  const Eigen::Vector3f size(0.4,0.4,0.6);
+  for(int i=0; i<num_objects; ++i){
+    const Eigen::Vector3f center(i%side,i/side,0.3);
+    Object *obj = new Object("object_"+std::to_string(i),center,center-size/2,center+size/2);
+    obj->classId() = i%10;
+    obj->octree()->updateNode(octomap::point3d(center.x(),center.y(),center.z()),true);
+    view->objects.push_back(ObjectConstPtr(obj));
+  }
+  return view;
+}
+
+//args: number of objects
+static void BM_MapIndexBuild(benchmark::State &state){
+  const MapViewConstPtr view = makeGridView(state.range(0));
+  for(auto _ : state){
+    MapIndex index(view);
+    benchmark::DoNotOptimize(index.size());
+  }
+}
+BENCHMARK(BM_MapIndexBuild)
+->Arg(1000)->Arg(4000)->Arg(16000)
+->Unit(benchmark::kMillisecond);
+
+//args: number of objects, query (0: nearest, 1: nearest of a class, 2: 3x3m region, 3: occupied point)
+static void BM_MapIndexQuery(benchmark::State &state){
+  const int num_objects = state.range(0);
+  const int query = state.range(1);
+  const MapIndex index(makeGridView(num_objects));
+  const float side = std::ceil(std::sqrt((float)num_objects));
+
+  std::vector<int> result;
+  unsigned int seed = 0;
+  for(auto _ : state){
+    const Eigen::Vector3f point(side*rand_r(&seed)/RAND_MAX,side*rand_r(&seed)/RAND_MAX,0.3);
+    float value = 0;
+    switch(query){
+      case 0:
+        benchmark::DoNotOptimize(index.nearest(point,MapIndex::ANY,value));
+        break;
+      case 1:
+        benchmark::DoNotOptimize(index.nearest(point,3,value));
+        break;
+      case 2:
+        index.inRegion(point-Eigen::Vector3f(1.5,1.5,1.5),point+Eigen::Vector3f(1.5,1.5,1.5),MapIndex::ANY,result);
+        benchmark::DoNotOptimize(result.size());
+        break;
+      default:
+        benchmark::DoNotOptimize(index.occupied(Eigen::Vector3f(std::round(point.x()),std::round(point.y()),0.3),value));
+    }
+  }
+}
+BENCHMARK(BM_MapIndexQuery)
+->ArgsProduct({{1000,4000,16000},{0,1,2,3}})
+->Unit(benchmark::kMicrosecond);
+
+BENCHMARK_MAIN();
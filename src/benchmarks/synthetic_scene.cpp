@@ -0,0 +1,94 @@
+#include "synthetic_scene.h"
+
+#include <random>
+
+SyntheticScene::SyntheticScene(int width_, int height_, int num_models_):
+  _camera_cloud(new PointCloud()),
+  _world_cloud(new PointCloud()){
+
+  _camera_transform.setIdentity();
+
+  Eigen::Isometry3f camera_offset = Eigen::Isometry3f::Identity();
+  camera_offset.linear() = Eigen::Quaternionf(0.5,-0.5,0.5,-0.5).toRotationMatrix();
+
+  //kinect-like intrinsics scaled to the image size
+  const float f = 525.0f*width_/640.0f;
+  const float cx = width_/2.0f;
+  const float cy = height_/2.0f;
+
+  //models are placed on a grid of cells, each box covers the central part of its cell
+  const int grid_cols = std::ceil(std::sqrt((float)num_models_));
+  const int grid_rows = std::ceil((float)num_models_/grid_cols);
+  const float cell_w = (float)width_/grid_cols;
+  const float cell_h = (float)height_/grid_rows;
+
+  std::vector<Eigen::Vector3f> min(num_models_,Eigen::Vector3f::Constant(std::numeric_limits<float>::max()));
+  std::vector<Eigen::Vector3f> max(num_models_,Eigen::Vector3f::Constant(-std::numeric_limits<float>::max()));
+
+  _camera_cloud->width = width_;
+  _camera_cloud->height = height_;
+  _camera_cloud->is_dense = true;
+  _camera_cloud->points.resize(width_*height_);
+
+  for(int r=0; r<height_; ++r)
+    for(int c=0; c<width_; ++c){
+      int col = c/cell_w;
+      int row = r/cell_h;
+      float u = (c - col*cell_w)/cell_w;
+      float v = (r - row*cell_h)/cell_h;
+      int model = row*grid_cols+col;
+      bool on_box = model < num_models_ && u > 0.2f && u < 0.8f && v > 0.2f && v < 0.8f;
+
+      float d = on_box ? 2.5f : 4.0f;
+      Point &p = _camera_cloud->at(c,r);
+      p.x = (c-cx)*d/f;
+      p.y = (r-cy)*d/f;
+      p.z = d;
+      p.r = p.g = p.b = 128;
+
+      if(!on_box)
+        continue;
+
+      Eigen::Vector3f world_point = camera_offset*Eigen::Vector3f(p.x,p.y,p.z);
+      min[model] = min[model].cwiseMin(world_point);
+      max[model] = max[model].cwiseMax(world_point);
+    }
+
+  pcl::transformPointCloud(*_camera_cloud,*_world_cloud,_camera_transform*camera_offset);
+
+  _models.resize(num_models_);
+  for(int i=0; i<num_models_; ++i){
+    std::stringstream type;
+    type << "box_" << i;
+    _models[i].type() = type.str();
+    _models[i].min() = min[i]-Eigen::Vector3f::Constant(0.01f);
+    _models[i].max() = max[i]+Eigen::Vector3f::Constant(0.01f);
+  }
+}
+
+PointCloud::Ptr makeBoxCloud(int num_points,
+                             const Eigen::Vector3f &center,
+                             const Eigen::Vector3f &size,
+                             unsigned int seed){
+  std::mt19937 generator(seed);
+  std::uniform_real_distribution<float> uniform(-0.5f,0.5f);
+  std::uniform_int_distribution<int> face(0,5);
+
+  PointCloud::Ptr cloud(new PointCloud());
+  cloud->points.resize(num_points);
+  for(int i=0; i<num_points; ++i){
+    Eigen::Vector3f p(uniform(generator),uniform(generator),uniform(generator));
+    int f = face(generator);
+    p[f/2] = (f%2) ? 0.5f : -0.5f;
+    p = center + p.cwiseProduct(size);
+
+    Point &pt = cloud->points[i];
+    pt.x = p.x();
+    pt.y = p.y();
+    pt.z = p.z();
+    pt.r = pt.g = pt.b = 128;
+  }
+  cloud->width = num_points;
+  cloud->height = 1;
+  return cloud;
+}
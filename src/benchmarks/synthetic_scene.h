@@ -0,0 +1,36 @@
+#pragma once
+
+#include <object_detector/model.h>
+#include <semantic_mapper/object.h>
+
+//this class generates organized clouds and logical camera models without a ros runtime:
+//a wall at 4m with num_models planar boxes at 2.5m laid out on a grid in the image
+class SyntheticScene{
+  public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    SyntheticScene(int width_ = 640, int height_ = 480, int num_models_ = 1);
+
+    //camera pose used for the detector and the mapper
+    inline const Eigen::Isometry3f &cameraTransform() const {return _camera_transform;}
+
+    //organized cloud in the camera optical frame (what the depth camera publishes)
+    inline const PointCloud::Ptr &cameraCloud() const {return _camera_cloud;}
+
+    //organized cloud in the map frame (what the detector consumes)
+    inline const PointCloud::Ptr &worldCloud() const {return _world_cloud;}
+
+    inline const ModelVector &models() const {return _models;}
+
+  private:
+    Eigen::Isometry3f _camera_transform;
+    PointCloud::Ptr _camera_cloud;
+    PointCloud::Ptr _world_cloud;
+    ModelVector _models;
+};
+
+//random points on the surface of a box of the given size, centered in center
+PointCloud::Ptr makeBoxCloud(int num_points,
+                             const Eigen::Vector3f &center,
+                             const Eigen::Vector3f &size,
+                             unsigned int seed = 0);
@@ -0,0 +1,1001 @@
+#pragma once
+
+#include <iostream>
+
+#include <ros/ros.h>
+#include <ros/package.h>
+#include <ros/callback_queue.h>
+#include <ros/spinner.h>
+
+#include <image_transport/image_transport.h>
+#include <cv_bridge/cv_bridge.h>
+#include <lucrezio_simulation_environments/LogicalImage.h>
+#include <tf/tf.h>
+#include <tf/transform_datatypes.h>
+#include <tf/transform_listener.h>
+#include <tf/transform_broadcaster.h>
+#include <geometry_msgs/PoseWithCovarianceStamped.h>
+#include <sensor_msgs/CameraInfo.h>
+#include <message_filters/subscriber.h>
+#include <message_filters/synchronizer.h>
+#include <message_filters/sync_policies/approximate_time.h>
+
+#include <object_detector/object_detector.h>
+#include <semantic_mapper/semantic_mapper.h>
+#include <semantic_mapper/map_cloud.h>
+#include <semantic_mapper/map_persistence.h>
+#include <semantic_mapper/map_index.h>
+#include <semantic_mapper/map_memory.h>
+#include <utils/conversions.h>
+#include <utils/profiler.h>
+#include <utils/publish_scheduler.h>
+
+#include <lucrezio_semantic_mapper/SemanticMap.h>
+#include <lucrezio_semantic_mapper/NearestObject.h>
+#include <lucrezio_semantic_mapper/ObjectsInRegion.h>
+#include <lucrezio_semantic_mapper/PointOccupied.h>
+#include <lucrezio_semantic_mapper/MemoryReport.h>
+
+#include <pcl_ros/point_cloud.h>
+#include <pcl_conversions/pcl_conversions.h>
+
+#include <visualization_msgs/Marker.h>
+#include <diagnostic_msgs/DiagnosticArray.h>
+
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <memory>
+
+typedef cv::Mat_<cv::Vec3b> RGBImage;
+
+typedef message_filters::sync_policies::ApproximateTime<lucrezio_simulation_environments::LogicalImage,
+PointCloud> FilterSyncPolicy;
+typedef message_filters::sync_policies::ApproximateTime<lucrezio_simulation_environments::LogicalImage,
+sensor_msgs::Image> DepthImageSyncPolicy;
+
+//one camera stream with its own detector and mapper, processed by its own spinner thread.
+//All the cameras feed the same global map
+struct Camera{
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+  Camera(const GlobalMapPtr &global_map):
+    synchronizer(FilterSyncPolicy(1000)),
+    depth_image_synchronizer(DepthImageSyncPolicy(1000)),
+    mapper(global_map),
+    depth_points(new PointCloud()),
+    transformed_cloud(new PointCloud()){}
+
+  std::string name;
+
+  //callbacks of this camera are served by its own thread
+  ros::NodeHandle nh;
+  ros::CallbackQueue queue;
+  std::unique_ptr<ros::AsyncSpinner> spinner;
+
+  //synchronized subscriber to rgbd frame and logical_image
+  message_filters::Subscriber<lucrezio_simulation_environments::LogicalImage> logical_image_sub;
+  message_filters::Subscriber<PointCloud> depth_points_sub;
+  message_filters::Synchronizer<FilterSyncPolicy> synchronizer;
+
+  //synchronized subscriber to depth image and logical_image, with camera info
+  message_filters::Subscriber<sensor_msgs::Image> depth_image_sub;
+  message_filters::Synchronizer<DepthImageSyncPolicy> depth_image_synchronizer;
+  ros::Subscriber camera_info_sub;
+
+  //computing modules
+  ObjectDetector detector;
+  SemanticMapper mapper;
+
+  //frame buffers, reused by every frame of the camera (its callbacks run on one thread)
+  PointCloud::Ptr depth_points;
+  PointCloud::Ptr transformed_cloud;
+
+  //label image (visualization only), built lazily on the publishing thread
+  std::string label_topic;
+  std::string frame_id;
+  image_transport::Publisher label_image_pub;
+  std::mutex label_mutex;
+  DetectionVector label_detections;
+  ros::Time label_stamp;
+};
+
+//the mapper with its ros interface, run by semantic_mapper_node or loaded as a nodelet (see SemanticMapperNodelet)
+class SemanticMapperNode{
+
+public:
+  SemanticMapperNode(ros::NodeHandle nh_):
+    _nh(nh_),
+    _global_map(new GlobalMap()),
+    _it(_nh){
+
+    _sm_pub = _nh.advertise<lucrezio_semantic_mapper::SemanticMap>("/semantic_map",1);
+
+    _cloud_pub = _nh.advertise<PointCloud>("visualization_cloud",1);
+    _marker_pub = _nh.advertise<visualization_msgs::Marker>("visualization_markers",1);
+    _diagnostics_pub = _nh.advertise<diagnostic_msgs::DiagnosticArray>("/diagnostics",1);
+
+    double diagnostics_period;
+    _nh.param("diagnostics_period",diagnostics_period,1.0);
+    _diagnostics_timer = _nh.createTimer(ros::Duration(diagnostics_period),&SemanticMapperNode::diagnosticsCallback,this);
+    _nh.param("memory_report_top",_memory_report_top,5);
+    _window_start = getMonotonicTime();
+    _window_frames = 0;
+    _robot_position.setZero();
+
+    _camera_offset.setIdentity();
+    _camera_offset.linear() = Eigen::Quaternionf(0.5,-0.5,0.5,-0.5).toRotationMatrix();
+
+    //class ids and colors are shared by the detectors of all the cameras
+    ObjectDetector detector;
+    _nh.param("environment",detector.environment(),std::string("garage"));
+    detector.setupModelColors();
+    _registry = detector.sharedRegistry();
+
+    //camera streams: a list of names (each with its own topics), or the single default camera
+    std::vector<std::string> camera_names;
+    if(!_nh.getParam("cameras",camera_names) || camera_names.empty())
+      camera_names.push_back("");
+    for(const std::string &name : camera_names)
+      setupCamera(name,detector.environment());
+
+    //occupancy updates that do not fit in the budget run in later frames or when idle
+    double occupancy_budget, idle_period;
+    _nh.param("occupancy_budget",occupancy_budget,0.05);
+    _nh.param("occupancy_idle_budget",_occupancy_idle_budget,0.02);
+    _nh.param("occupancy_idle_period",idle_period,0.1);
+    _nh.param("occupancy_staleness_weight",_global_map->occupancyScheduler().stalenessWeight(),1.0f);
+    _nh.param("occupancy_distance_weight",_global_map->occupancyScheduler().distanceWeight(),1.0f);
+    _nh.param("occupancy_view_change_weight",_global_map->occupancyScheduler().viewChangeWeight(),1.0f);
+    for(const std::unique_ptr<Camera> &camera : _cameras)
+      camera->mapper.setOccupancyBudget(occupancy_budget);
+
+    //per-object steps run on one pool shared by the cameras (0: serial)
+    int mapper_threads;
+    _nh.param("mapper_threads",mapper_threads,0);
+    if(mapper_threads > 1){
+      _thread_pool.reset(new ThreadPool(mapper_threads));
+      for(const std::unique_ptr<Camera> &camera : _cameras)
+        camera->mapper.setThreadPool(_thread_pool);
+    }
+
+    //occupancy updates from (almost) the same view are skipped or downsampled
+    double min_view_distance, min_view_angle;
+    int downsample_stride;
+    _nh.param("occupancy_min_view_distance",min_view_distance,0.05);
+    _nh.param("occupancy_min_view_angle",min_view_angle,0.05);
+    _nh.param("occupancy_downsample_stride",downsample_stride,4);
+    _global_map->occupancyScheduler().setViewGate(min_view_distance,min_view_angle,downsample_stride);
+    _occupancy_timer = _nh.createTimer(ros::Duration(idle_period),&SemanticMapperNode::occupancyCallback,this);
+
+    //octree resolution of new objects: by class, else from the box extent (if octree_target_voxels > 0), else the default
+    ResolutionPolicy &resolution_policy = _global_map->resolutionPolicy();
+    double resolution, min_resolution, max_resolution, leaf_ratio;
+    int target_voxels;
+    bool dense_grid;
+    _nh.param("octree_resolution",resolution,0.05);
+    _nh.param("octree_target_voxels",target_voxels,0);
+    _nh.param("octree_min_resolution",min_resolution,0.01);
+    _nh.param("octree_max_resolution",max_resolution,0.2);
+    _nh.param("merge_leaf_ratio",leaf_ratio,0.4);
+    _nh.param("occupancy_dense_grid",dense_grid,false);
+    resolution_policy.setDefaultResolution(resolution);
+    resolution_policy.setTargetVoxels(target_voxels);
+    resolution_policy.setResolutionRange(min_resolution,max_resolution);
+    resolution_policy.setLeafRatio(leaf_ratio);
+    resolution_policy.setDenseGrid(dense_grid);
+    std::map<std::string,double> class_resolutions;
+    _nh.getParam("octree_class_resolutions",class_resolutions);
+    for(const std::pair<const std::string,double> &entry : class_resolutions){
+      const int class_id = _registry->id(entry.first);
+      if(class_id == ClassRegistry::UNKNOWN)
+        ROS_WARN("octree_class_resolutions: unknown class %s",entry.first.c_str());
+      else
+        resolution_policy.setClassResolution(class_id,entry.second);
+    }
+
+    //objects not observed for a while are compacted (0 disables it)
+    int freeze_after_frames, freeze_min_updates;
+    _nh.param("freeze_after_frames",freeze_after_frames,0);
+    _nh.param("freeze_min_updates",freeze_min_updates,1);
+    _global_map->setFreezePolicy(freeze_after_frames > 0 ? freeze_after_frames : 0,freeze_min_updates);
+
+    //far away tiles of the global map are evicted to disk and loaded back as the robot approaches
+    std::string tiles_directory;
+    _nh.param("tiles_directory",tiles_directory,std::string(""));
+    if(!tiles_directory.empty()){
+      double tile_size, load_radius, evict_radius;
+      _nh.param("tile_size",tile_size,10.0);
+      _nh.param("tile_load_radius",load_radius,15.0);
+      _nh.param("tile_evict_radius",evict_radius,25.0);
+      _global_map->tiles().setup(tiles_directory,tile_size,load_radius,evict_radius);
+    }
+
+    //the global map is periodically saved (snapshot + journal of the changed objects) and resumed at startup
+    std::string persistence_directory;
+    _nh.param("persistence_directory",persistence_directory,std::string(""));
+    if(!persistence_directory.empty()){
+      double snapshot_period, journal_period;
+      _nh.param("snapshot_period",snapshot_period,60.0);
+      _nh.param("journal_period",journal_period,1.0);
+      _persistence.setup(persistence_directory,_registry.get());
+
+      ObjectPtrVector objects;
+      const double start = getMonotonicTime();
+      if(_persistence.load(*_registry,objects)){
+        _global_map->restore(objects);
+        ROS_INFO("Resumed %lu objects in %f seconds",objects.size(),getMonotonicTime()-start);
+      }
+      _journal_timer = _nh.createTimer(ros::Duration(journal_period),&SemanticMapperNode::journalCallback,this);
+      _snapshot_timer = _nh.createTimer(ros::Duration(snapshot_period),&SemanticMapperNode::snapshotCallback,this);
+    }
+
+    //outputs are published at a configurable rate (Hz, 0: every frame), only if somebody listens
+    double label_image_rate, semantic_map_rate, cloud_rate, markers_rate;
+    _nh.param("label_image_rate",label_image_rate,0.0);
+    _nh.param("semantic_map_rate",semantic_map_rate,0.0);
+    _nh.param("visualization_cloud_rate",cloud_rate,0.0);
+    _nh.param("visualization_markers_rate",markers_rate,0.0);
+    for(const std::unique_ptr<Camera> &camera : _cameras){
+      Camera *c = camera.get();
+      _publisher.addTopic(c->label_topic,label_image_rate,
+                          [c](){return c->label_image_pub.getNumSubscribers() > 0;},
+                          [this,c](){publishLabelImage(c);});
+    }
+    _publisher.addTopic("semantic_map",semantic_map_rate,
+                        [this](){return _sm_pub.getNumSubscribers() > 0;},
+                        [this](){publishSemanticMap();});
+    _publisher.addTopic("visualization_cloud",cloud_rate,
+                        [this](){return _cloud_pub.getNumSubscribers() > 0;},
+                        [this](){publishCloud();});
+    _publisher.addTopic("visualization_markers",markers_rate,
+                        [this](){return _marker_pub.getNumSubscribers() > 0;},
+                        [this](){publishMarkers();});
+    _publisher.start();
+
+    //queries are answered on their own thread, so they do not wait for timers and snapshots
+    _query_nh = _nh;
+    _query_nh.setCallbackQueue(&_query_queue);
+    _nearest_srv = _query_nh.advertiseService("nearest_object",&SemanticMapperNode::nearestObjectCallback,this);
+    _region_srv = _query_nh.advertiseService("objects_in_region",&SemanticMapperNode::objectsInRegionCallback,this);
+    _occupied_srv = _query_nh.advertiseService("point_occupied",&SemanticMapperNode::pointOccupiedCallback,this);
+    _memory_srv = _query_nh.advertiseService("memory_report",&SemanticMapperNode::memoryReportCallback,this);
+    _query_spinner.reset(new ros::AsyncSpinner(1,&_query_queue));
+    _query_spinner->start();
+
+    //each camera is processed by its own thread
+    for(const std::unique_ptr<Camera> &camera : _cameras){
+      camera->spinner.reset(new ros::AsyncSpinner(1,&camera->queue));
+      camera->spinner->start();
+    }
+
+    ROS_INFO("Running semantic_mapper_node with %lu camera(s)...",_cameras.size());
+  }
+
+  ~SemanticMapperNode(){
+    for(const std::unique_ptr<Camera> &camera : _cameras)
+      camera->spinner->stop();
+    _query_spinner->stop();
+    _publisher.stop();
+    if(_persistence.enabled()){
+      const MapViewConstPtr view = _global_map->view();
+      _global_map->tiles().flush();
+      _persistence.recordChanges(*view);
+      _persistence.flush();
+    }
+  }
+
+  //topics of a camera are read from ~<name>/<topic>_topic, the default camera keeps the original topics
+  void setupCamera(const std::string &name, const std::string &environment){
+    _cameras.push_back(std::unique_ptr<Camera>(new Camera(_global_map)));
+    Camera *camera = _cameras.back().get();
+    camera->name = name;
+    camera->nh = _nh;
+    camera->nh.setCallbackQueue(&camera->queue);
+
+    const std::string prefix = name.empty() ? "" : name+"/";
+    const std::string ns = name.empty() ? "/camera" : "/"+name;
+    std::string logical_image_topic, depth_points_topic, depth_image_topic, camera_info_topic, label_image_topic;
+    _nh.param(prefix+"logical_image_topic",logical_image_topic,
+              name.empty() ? std::string("/gazebo/logical_camera_image") : ns+"/logical_camera_image");
+    _nh.param(prefix+"depth_points_topic",depth_points_topic,ns+"/depth/points");
+    _nh.param(prefix+"depth_image_topic",depth_image_topic,ns+"/depth/image_raw");
+    _nh.param(prefix+"camera_info_topic",camera_info_topic,ns+"/depth/camera_info");
+    _nh.param(prefix+"label_image_topic",label_image_topic,ns+"/rgb/label_image");
+    _nh.param(prefix+"frame_id",camera->frame_id,
+              name.empty() ? std::string("camera_depth_optical_frame") : name+"_depth_optical_frame");
+
+    camera->detector.environment() = environment;
+    camera->detector.shareRegistry(_registry);
+
+    //pixel stride (or pyramid level) and distance bands of detection and extraction
+    setupSampler("detection",camera->detector.sampler());
+    setupSampler("extraction",camera->mapper.sampler());
+
+    //the depth input is either an organized cloud or a depth image plus camera info
+    bool use_depth_image;
+    _nh.param("use_depth_image",use_depth_image,false);
+    camera->logical_image_sub.subscribe(camera->nh,logical_image_topic,1);
+    if(use_depth_image){
+      camera->depth_image_sub.subscribe(camera->nh,depth_image_topic,1);
+      camera->camera_info_sub = camera->nh.subscribe<sensor_msgs::CameraInfo>(camera_info_topic,1,
+                                                                               boost::bind(&SemanticMapperNode::cameraInfoCallback,this,camera,_1));
+      camera->depth_image_synchronizer.connectInput(camera->logical_image_sub,camera->depth_image_sub);
+      camera->depth_image_synchronizer.registerCallback(boost::bind(&SemanticMapperNode::depthImageCallback,this,camera,_1,_2));
+    } else {
+      camera->depth_points_sub.subscribe(camera->nh,depth_points_topic,1);
+      camera->synchronizer.connectInput(camera->logical_image_sub,camera->depth_points_sub);
+      camera->synchronizer.registerCallback(boost::bind(&SemanticMapperNode::filterCallback,this,camera,_1,_2));
+    }
+
+    camera->label_topic = name.empty() ? std::string("label_image") : "label_image_"+name;
+    camera->label_image_pub = _it.advertise(label_image_topic,1);
+  }
+
+  //the ray table is computed once from the camera intrinsics
+  void cameraInfoCallback(Camera *camera, const sensor_msgs::CameraInfo::ConstPtr &camera_info_msg){
+    Eigen::Matrix3f K;
+    for(int r=0; r<3; ++r)
+      for(int c=0; c<3; ++c)
+        K(r,c) = camera_info_msg->K[r*3+c];
+    camera->mapper.setCameraMatrix(K,camera_info_msg->width,camera_info_msg->height);
+  }
+
+  void depthImageCallback(Camera *camera,
+                          const lucrezio_simulation_environments::LogicalImage::ConstPtr &logical_image_msg,
+                          const sensor_msgs::Image::ConstPtr &depth_image_msg){
+
+    if(logical_image_msg->models.empty())
+      return;
+
+    if(!camera->mapper.hasRayTable()){
+      ROS_WARN_THROTTLE(5,"Waiting for camera info...");
+      return;
+    }
+
+    const PointCloud::Ptr &depth_points = camera->depth_points;
+    {
+      ScopedTimer timer(_unprojection_time);
+      cv_bridge::CvImageConstPtr depth_image = cv_bridge::toCvShare(depth_image_msg);
+      camera->mapper.unproject(depth_image->image,depth_points);
+      depth_points->header.frame_id = depth_image_msg->header.frame_id;
+      pcl_conversions::toPCL(depth_image_msg->header.stamp,depth_points->header.stamp);
+    }
+
+    filterCallback(camera,logical_image_msg,depth_points);
+  }
+
+  //runs on the thread of the camera, only the global map is shared with the other cameras
+  void filterCallback(Camera *camera,
+                      const lucrezio_simulation_environments::LogicalImage::ConstPtr &logical_image_msg,
+                      const PointCloud::ConstPtr &depth_points_msg){
+
+    //check that the there's at list one object in the robot field-of-view
+    if(logical_image_msg->models.empty())
+      return;
+
+    //check that delay between messages is below a threshold
+    ros::Time image_stamp = logical_image_msg->header.stamp;
+    ros::Time depth_stamp;
+    //pcl_conversions::fromPCL(depth_points_msg->header.stamp,depth_stamp);
+    //ros::Duration stamp_diff = image_stamp - depth_stamp;
+//    std::cerr << "Logical stamp: " << image_stamp.toSec() << std::endl;
+//    std::cerr << "Depth stamp: " << depth_stamp.toSec() << std::endl;
+//    std::cerr << "Diff: " << std::abs(stamp_diff.toSec()) << std::endl;
+/*    if(std::abs(stamp_diff.toSec()) > 0.05)
+      std::cerr << "TE ENCONTRE LA CHUCHA!" <<std::endl;
+      return;*/
+
+    ScopedTimer frame_timer(_frame_time);
+
+    ObjectDetector &detector = camera->detector;
+    SemanticMapper &mapper = camera->mapper;
+
+    Eigen::Isometry3f camera_transform;
+    const PointCloud::Ptr &transformed_cloud = camera->transformed_cloud;
+    {
+      ScopedTimer timer(_conversion_time);
+
+      //get camera pose
+      camera_transform = poseMsg2eigen(logical_image_msg->pose);
+
+      //get models (written in place, the detector keeps them)
+      logicalImageToModels(logical_image_msg,detector.registry(),detector.models());
+
+      //get point cloud
+      pcl::transformPointCloud (*depth_points_msg, *transformed_cloud, camera_transform*_camera_offset);
+    }
+
+    //compute detections
+    {
+      ScopedTimer timer(_detection_time);
+      detector.setCameraTransform(camera_transform);
+      detector.setInputCloud(transformed_cloud);
+      detector.setupDetections();
+      detector.compute();
+    }
+    const DetectionVector &detections = detector.detections();
+
+    //the label image is built later, keep the detections only if it will be published
+    {
+      std::lock_guard<std::mutex> lock(camera->label_mutex);
+      if(_publisher.wants(camera->label_topic))
+        camera->label_detections = detections;
+      else
+        camera->label_detections.clear();
+      camera->label_stamp = image_stamp;
+    }
+
+    //extract objects from detections
+    {
+      ScopedTimer timer(_extraction_time);
+      mapper.setGlobalT(camera_transform);
+      mapper.extractObjects(detections,depth_points_msg);
+    }
+
+    //data association
+    {
+      ScopedTimer timer(_association_time);
+      mapper.findAssociations();
+    }
+
+    //update
+    {
+      ScopedTimer timer(_merge_time);
+      mapper.mergeMaps();
+    }
+
+    //data time covered by the current window
+    {
+      std::lock_guard<std::mutex> lock(_stamp_mutex);
+      if(image_stamp > _last_timestamp)
+        _last_timestamp = image_stamp;
+      _robot_position = camera_transform.translation();
+      if(!_window_frames)
+        _window_first_stamp = image_stamp;
+      _window_last_stamp = image_stamp;
+      _window_frames++;
+    }
+
+    //outputs are built and published by the publishing thread
+    _publisher.notify();
+  }
+
+  //publish label image
+  void publishLabelImage(Camera *camera){
+    ScopedTimer timer(_publish_time);
+    std::lock_guard<std::mutex> lock(camera->label_mutex);
+    if(camera->label_detections.empty())
+      return;
+    sensor_msgs::ImagePtr label_image_msg;
+    makeLabelImageFromDetections(label_image_msg,camera->label_detections,camera->label_stamp,camera->frame_id);
+    camera->label_image_pub.publish(label_image_msg);
+  }
+
+  //publish semantic map message
+  void publishSemanticMap(){
+    ScopedTimer timer(_publish_time);
+    const MapViewConstPtr view = _global_map->view();
+    if(view->objects.empty())
+      return;
+    lucrezio_semantic_mapper::SemanticMap sm_msg;
+    makeMsgFromMap(sm_msg,&view->objects);
+    _sm_pub.publish(sm_msg);
+    _latency.record((ros::Time::now()-lastTimestamp()).toSec());
+  }
+
+  //publish map point cloud (only the objects that changed are copied)
+  void publishCloud(){
+    ScopedTimer timer(_publish_time);
+    const MapViewConstPtr view = _global_map->view();
+    if(view->objects.empty())
+      return;
+    _map_cloud.update(*view);
+    pcl_conversions::toPCL(lastTimestamp(), _map_cloud.cloud()->header.stamp);
+    _cloud_pub.publish(*_map_cloud.cloud());
+  }
+
+  //publish object bounding boxes
+  void publishMarkers(){
+    ScopedTimer timer(_publish_time);
+    const MapViewConstPtr view = _global_map->view();
+    if(view->objects.empty())
+      return;
+    visualization_msgs::Marker marker;
+    makeMarkerFromMap(marker,&view->objects);
+    _marker_pub.publish(marker);
+  }
+
+  //run deferred occupancy updates between frames
+  void occupancyCallback(const ros::TimerEvent &event){
+    Eigen::Vector3f robot_position;
+    {
+      std::lock_guard<std::mutex> lock(_stamp_mutex);
+      robot_position = _robot_position;
+    }
+    if(_global_map->processOccupancy(robot_position,_occupancy_idle_budget,_thread_pool.get()))
+      _global_map->publish();
+  }
+
+  //the records are serialized from the latest snapshot and written by the persistence thread,
+  //the records of evicted objects are read back from their tile files (written before the snapshot was taken)
+  void journalCallback(const ros::TimerEvent &event){
+    const MapViewConstPtr view = _global_map->view();
+    _global_map->tiles().flush();
+    _persistence.recordChanges(*view);
+  }
+
+  void snapshotCallback(const ros::TimerEvent &event){
+    const MapViewConstPtr view = _global_map->view();
+    _global_map->tiles().flush();
+    _persistence.recordSnapshot(*view);
+  }
+
+  //the index is rebuilt by the first query after a new snapshot is published (query thread only)
+  const MapIndex &mapIndex(){
+    const MapViewConstPtr view = _global_map->view();
+    if(!_index || _index->epoch() != view->epoch)
+      _index.reset(new MapIndex(view));
+    return *_index;
+  }
+
+  //an empty type matches any class, an unknown one matches nothing
+  inline int queryClass(const std::string &type) const {
+    if(type.empty())
+      return MapIndex::ANY;
+    const int class_id = _registry->id(type);
+    return class_id == ClassRegistry::UNKNOWN ? -2 : class_id;
+  }
+
+  bool nearestObjectCallback(lucrezio_semantic_mapper::NearestObject::Request &req,
+                             lucrezio_semantic_mapper::NearestObject::Response &res){
+    ScopedTimer timer(_query_time);
+    const MapIndex &index = mapIndex();
+    const int i = index.nearest(Eigen::Vector3f(req.point.x,req.point.y,req.point.z),queryClass(req.type),res.distance);
+    res.found = i >= 0;
+    if(res.found)
+      makeObjectMsg(res.object,index.object(i));
+    return true;
+  }
+
+  bool objectsInRegionCallback(lucrezio_semantic_mapper::ObjectsInRegion::Request &req,
+                               lucrezio_semantic_mapper::ObjectsInRegion::Response &res){
+    ScopedTimer timer(_query_time);
+    const MapIndex &index = mapIndex();
+    std::vector<int> objects;
+    index.inRegion(Eigen::Vector3f(req.min.x,req.min.y,req.min.z),
+                   Eigen::Vector3f(req.max.x,req.max.y,req.max.z),
+                   queryClass(req.type),
+                   objects);
+    res.objects.resize(objects.size());
+    for(size_t i=0; i<objects.size(); ++i)
+      makeObjectMsg(res.objects[i],index.object(objects[i]));
+    return true;
+  }
+
+  bool pointOccupiedCallback(lucrezio_semantic_mapper::PointOccupied::Request &req,
+                             lucrezio_semantic_mapper::PointOccupied::Response &res){
+    ScopedTimer timer(_query_time);
+    const MapIndex &index = mapIndex();
+    res.probability = 0;
+    const int i = index.occupied(Eigen::Vector3f(req.point.x,req.point.y,req.point.z),res.probability);
+    res.occupied = i >= 0;
+    if(res.occupied)
+      makeObjectMsg(res.object,index.object(i));
+    return true;
+  }
+
+  bool memoryReportCallback(lucrezio_semantic_mapper::MemoryReport::Request &req,
+                            lucrezio_semantic_mapper::MemoryReport::Response &res){
+    const MapMemory memory(*_global_map);
+    std::stringstream report;
+    memory.write(report,std::max(0,req.top));
+    res.report = report.str();
+    res.total_bytes = memory.total().total();
+    return true;
+  }
+
+  //map-wide memory by component and the objects that use most of it
+  void makeMemoryStatus(diagnostic_msgs::DiagnosticStatus &status){
+    status.name = ros::this_node::getName() + ": memory";
+    status.hardware_id = "semantic_mapper";
+    status.level = diagnostic_msgs::DiagnosticStatus::OK;
+
+    const MapMemory memory(*_global_map);
+    const ObjectMemory &total = memory.total();
+
+    std::stringstream message;
+    message << total.total()/1048576.0 << " MB in " << memory.size() << " objects";
+    status.message = message.str();
+
+    addKeyValue(status,"cloud [MB]",total.cloud/1048576.0);
+    addKeyValue(status,"occupancy [MB]",total.occupancy/1048576.0);
+    addKeyValue(status,"voxel clouds [MB]",total.voxel_clouds/1048576.0);
+    for(int i : memory.top(_memory_report_top))
+      addKeyValue(status,"object "+memory.object(i).model+" [MB]",memory.object(i).memory.total()/1048576.0);
+  }
+
+  //publish latency summaries on /diagnostics
+  void diagnosticsCallback(const ros::TimerEvent &event){
+    const double now = getMonotonicTime();
+    const double wall_time = now-_window_start;
+
+    int window_frames;
+    ros::Time window_first_stamp, window_last_stamp;
+    {
+      std::lock_guard<std::mutex> lock(_stamp_mutex);
+      window_frames = _window_frames;
+      window_first_stamp = _window_first_stamp;
+      window_last_stamp = _window_last_stamp;
+      _window_frames = 0;
+    }
+
+    diagnostic_msgs::DiagnosticStatus status;
+    status.name = ros::this_node::getName() + ": pipeline";
+    status.hardware_id = "semantic_mapper";
+    status.level = diagnostic_msgs::DiagnosticStatus::OK;
+
+    std::stringstream message;
+    message << window_frames << " frames in the last " << wall_time << " s";
+    status.message = message.str();
+
+    addKeyValue(status,"frames/s",window_frames/std::max(wall_time,1e-9));
+    double real_time_factor = 0;
+    if(window_frames > 1)
+      real_time_factor = (window_last_stamp-window_first_stamp).toSec()/std::max(wall_time,1e-9);
+    addKeyValue(status,"real-time factor",real_time_factor);
+
+    addKeyValue(status,"pending occupancy updates",_global_map->occupancyScheduler().pending());
+    addKeyValue(status,"executed occupancy updates",_global_map->occupancyScheduler().executed());
+    addKeyValue(status,"superseded occupancy updates",_global_map->occupancyScheduler().superseded());
+    addKeyValue(status,"skipped occupancy updates",_global_map->occupancyScheduler().skipped());
+    addKeyValue(status,"downsampled occupancy updates",_global_map->occupancyScheduler().downsampled());
+    addKeyValue(status,"occupancy skip rate",_global_map->occupancyScheduler().skipRate());
+
+    if(_global_map->tiles().enabled()){
+      GlobalMap::SharedLock lock(_global_map->mutex());
+      addKeyValue(status,"resident objects",_global_map->tiles().residentObjects());
+      addKeyValue(status,"evicted objects",_global_map->tiles().evictedObjects());
+      addKeyValue(status,"loading objects",_global_map->tiles().loading());
+      addKeyValue(status,"tile evictions",_global_map->tiles().evictions());
+      addKeyValue(status,"tile loads",_global_map->tiles().loads());
+    }
+
+    addKeyValue(status,"frozen objects",_global_map->frozenObjects());
+    addKeyValue(status,"object freezes",_global_map->freezes());
+
+    addSummary(status,"unprojection",_unprojection_time.drain());
+    addSummary(status,"conversion",_conversion_time.drain());
+    addSummary(status,"detection",_detection_time.drain());
+    addSummary(status,"extraction",_extraction_time.drain());
+    addSummary(status,"association",_association_time.drain());
+    addSummary(status,"merge",_merge_time.drain());
+    addSummary(status,"publish",_publish_time.drain());
+    addSummary(status,"query",_query_time.drain());
+    addSummary(status,"frame",_frame_time.drain());
+    addSummary(status,"stamp-to-publish",_latency.drain());
+
+    diagnostic_msgs::DiagnosticArray diagnostics;
+    diagnostics.header.stamp = ros::Time::now();
+    diagnostics.status.push_back(status);
+    if(_memory_report_top >= 0){
+      diagnostics.status.push_back(diagnostic_msgs::DiagnosticStatus());
+      makeMemoryStatus(diagnostics.status.back());
+    }
+    _diagnostics_pub.publish(diagnostics);
+
+    _window_start = now;
+  }
+
+protected:
+
+  //ros stuff
+  ros::NodeHandle _nh;
+
+  //newest frame stamp and robot position (over all the cameras), guarded by _stamp_mutex
+  std::mutex _stamp_mutex;
+  ros::Time _last_timestamp;
+  Eigen::Vector3f _robot_position;
+
+  Eigen::Isometry3f _camera_offset;
+
+  //global map shared by the cameras (see GlobalMap for the locking scheme) and their class registry
+  GlobalMapPtr _global_map;
+  ClassRegistryPtr _registry;
+
+  //workers of the per-object steps of all the cameras (null: serial)
+  ThreadPoolPtr _thread_pool;
+
+  //input streams
+  std::vector<std::unique_ptr<Camera> > _cameras;
+
+  //semantic map publisher
+  ros::Publisher _sm_pub;
+
+  //publisher for the label images (visualization only)
+  image_transport::ImageTransport _it;
+  ros::Publisher _cloud_pub;
+  MapCloud _map_cloud;
+  ros::Publisher _marker_pub;
+
+  //outputs are built lazily on the publishing thread from the latest map snapshot
+  PublishScheduler _publisher;
+
+  //deferred occupancy updates
+  ros::Timer _occupancy_timer;
+  double _occupancy_idle_budget;
+
+  //map snapshot and journal
+  MapPersistence _persistence;
+  ros::Timer _journal_timer;
+  ros::Timer _snapshot_timer;
+
+  //spatial and semantic queries, answered from an index of the latest map snapshot
+  ros::NodeHandle _query_nh;
+  ros::CallbackQueue _query_queue;
+  std::unique_ptr<ros::AsyncSpinner> _query_spinner;
+  ros::ServiceServer _nearest_srv;
+  ros::ServiceServer _region_srv;
+  ros::ServiceServer _occupied_srv;
+  ros::ServiceServer _memory_srv;
+  MapIndexConstPtr _index;
+  LatencyHistogram _query_time;
+
+  //per-stage latencies, published on /diagnostics
+  ros::Publisher _diagnostics_pub;
+  ros::Timer _diagnostics_timer;
+
+  //objects listed in the memory diagnostics (negative: no memory diagnostics)
+  int _memory_report_top;
+  LatencyHistogram _unprojection_time;
+  LatencyHistogram _conversion_time;
+  LatencyHistogram _detection_time;
+  LatencyHistogram _extraction_time;
+  LatencyHistogram _association_time;
+  LatencyHistogram _merge_time;
+  LatencyHistogram _publish_time;
+  LatencyHistogram _frame_time;
+  LatencyHistogram _latency;
+  double _window_start;
+  int _window_frames;
+  ros::Time _window_first_stamp;
+  ros::Time _window_last_stamp;
+
+private:
+
+  inline ros::Time lastTimestamp(){
+    std::lock_guard<std::mutex> lock(_stamp_mutex);
+    return _last_timestamp;
+  }
+
+  //reads <stage>_stride, <stage>_pyramid_level, <stage>_band_ranges and <stage>_band_strides
+  void setupSampler(const std::string &stage, PixelSampler &sampler){
+    int stride, level;
+    _nh.param(stage+"_stride",stride,1);
+    sampler.setStride(stride);
+    if(_nh.getParam(stage+"_pyramid_level",level))
+      sampler.setPyramidLevel(level);
+
+    std::vector<double> band_ranges;
+    std::vector<int> band_strides;
+    if(_nh.getParam(stage+"_band_ranges",band_ranges) && _nh.getParam(stage+"_band_strides",band_strides)){
+      if(band_ranges.size() != band_strides.size()){
+        ROS_WARN("%s bands: ranges and strides have different sizes",stage.c_str());
+        return;
+      }
+      for(size_t i=0; i<band_ranges.size(); ++i)
+        sampler.addBand(band_ranges[i],band_strides[i]);
+    }
+  }
+
+  void addKeyValue(diagnostic_msgs::DiagnosticStatus &status, const std::string &key, double value){
+    diagnostic_msgs::KeyValue kv;
+    kv.key = key;
+    std::stringstream stream;
+    stream << value;
+    kv.value = stream.str();
+    status.values.push_back(kv);
+  }
+
+  void addSummary(diagnostic_msgs::DiagnosticStatus &status, const std::string &stage, const LatencyHistogram::Summary &summary){
+    addKeyValue(status,stage+" p50 [ms]",summary.p50*1e3);
+    addKeyValue(status,stage+" p95 [ms]",summary.p95*1e3);
+    addKeyValue(status,stage+" p99 [ms]",summary.p99*1e3);
+    addKeyValue(status,stage+" max [ms]",summary.max*1e3);
+  }
+
+  //type, position, boxes and color (no files)
+  void makeObjectMsg(lucrezio_semantic_mapper::Object &o, const Object &obj){
+    o.type = obj.model();
+    o.position.x = obj.position().x();
+    o.position.y = obj.position().y();
+    o.position.z = obj.position().z();
+    o.min.x = obj.min().x();
+    o.min.y = obj.min().y();
+    o.min.z = obj.min().z();
+    o.max.x = obj.max().x();
+    o.max.y = obj.max().y();
+    o.max.z = obj.max().z();
+    o.color.x = obj.color().x();
+    o.color.y = obj.color().y();
+    o.color.z = obj.color().z();
+  }
+
+  void makeMsgFromMap(lucrezio_semantic_mapper::SemanticMap &sm_msg, const ObjectConstPtrVector *global_map){
+    sm_msg.header.stamp = lastTimestamp();
+    sm_msg.header.frame_id = "/map";
+    float volumes=0;
+    std::ofstream outfile;
+    for(int i=0; i<global_map->size(); ++i){
+      const ObjectConstPtr& obj = global_map->at(i);
+      lucrezio_semantic_mapper::Object o;
+      //model
+      o.type = obj->model();
+
+      //position
+      o.position.x = obj->position().x();
+      o.position.y = obj->position().y();
+      o.position.z = obj->position().z();
+
+      //min
+      o.min.x = obj->min().x();
+      o.min.y = obj->min().y();
+      o.min.z = obj->min().z();
+
+      //max
+      o.max.x = obj->max().x();
+      o.max.y = obj->max().y();
+      o.max.z = obj->max().z();
+
+      //max
+      o.color.x = obj->color().x();
+      o.color.y = obj->color().y();
+      o.color.z = obj->color().z();
+
+      //volume
+
+      volumes= ((o.max.x-o.min.x+0.02)*(o.max.y-o.min.y+0.02)*(o.max.z-o.min.z+0.02));
+      
+      std::string volume_filename = obj->model()+"_volume.txt";
+
+       double seconds = ros::Time::now().toSec();
+      outfile.open(volume_filename.c_str(),std::ios_base::app);
+      outfile << seconds << "\t" << volumes << "\t" << obj->ocupancy_volume() << "\t" 
+      << (obj->ocupancy_volume()/volumes)*100 << "\t" << obj->numFreeVoxels() <<"\t" 
+      << obj->numOccupiedVoxels() <<"\n";
+      
+      outfile.close(); 
+
+      //cloud
+      const std::string cloud_filename = obj->model()+".pcd";
+      o.cloud_filename = cloud_filename;
+      //the files of evicted objects were written while they were resident
+      if(obj->resident())
+        pcl::io::savePCDFileASCII(cloud_filename,*(obj->fullCloud()));
+
+      //octree
+      const std::string octree_filename = obj->model()+".bt";
+      o.octree_filename = octree_filename;
+      if(obj->resident())
+        obj->octree()->writeBinaryConst(octree_filename);
+
+
+      //fre voxel cloud
+      o.fre_voxel_cloud_filename = "...";
+      if(obj->numFreeVoxels() && !obj->frozen()){
+       const std::string fre_voxel_cloud_filename = obj->model()+"_fre.pcd";
+       o.fre_voxel_cloud_filename = fre_voxel_cloud_filename;
+      pcl::io::savePCDFileASCII(fre_voxel_cloud_filename,*(obj->freVoxelCloud()));
+      }
+
+      //occ voxel cloud
+      o.occ_voxel_cloud_filename = "...";
+      if(obj->numOccupiedVoxels() && !obj->frozen()){
+       const std::string occ_voxel_cloud_filename = obj->model()+"_occ.pcd";
+       o.occ_voxel_cloud_filename = occ_voxel_cloud_filename;
+       pcl::io::savePCDFileASCII(occ_voxel_cloud_filename,*(obj->occVoxelCloud()));
+      }
+      std::cerr << obj->model() << " timestamp: " << obj->ocupancy_volume() << std::endl;
+      sm_msg.objects.push_back(o);
+    }
+  }
+
+  void makeLabelImageFromDetections(sensor_msgs::ImagePtr &label_image_msg,
+                                    const DetectionVector &detections,
+                                    const ros::Time &stamp,
+                                    const std::string &frame_id){
+    RGBImage label_image;
+    label_image.create(480,640);
+    label_image=cv::Vec3b(0,0,0);
+    for(int i=0; i < detections.size(); ++i){
+      cv::Vec3b color(detections[i].color().x(),detections[i].color().y(),detections[i].color().z());
+      for(int j=0; j < detections[i].pixels().size(); ++j){
+        int r = detections[i].pixels()[j].x();
+        int c = detections[i].pixels()[j].y();
+
+        label_image.at<cv::Vec3b>(r,c) = color;
+      }
+    }
+    std_msgs::Header header;
+    header.stamp = stamp;
+    header.frame_id = frame_id;
+    label_image_msg = cv_bridge::CvImage(header,
+                                         "bgr8",
+                                         label_image).toImageMsg();
+  }
+
+  void makeMarkerFromMap(visualization_msgs::Marker &marker, const ObjectConstPtrVector *global_map){
+    marker.header.frame_id = "/map";
+    marker.header.stamp = lastTimestamp();
+    marker.ns = "basic_shapes";
+    //  marker.id = i;
+    marker.type = visualization_msgs::Marker::LINE_LIST;
+    marker.action = visualization_msgs::Marker::ADD;
+
+    for(int i=0; i < global_map->size(); ++i){
+      const ObjectConstPtr& object = global_map->at(i);
+
+      marker.scale.x = 0.015;
+      marker.scale.y = 0.0;
+      marker.scale.z = 0.0;
+
+      geometry_msgs::Point min,max;
+      min.x = object->min().x();min.y = object->min().y();min.z = object->min().z();
+      max.x = object->max().x();max.y = object->max().y();max.z = object->max().z();
+
+      geometry_msgs::Point a,b,c,d,e,f,g,h;
+      a.x=min.x;a.y=min.y;a.z=min.z;
+      b.x=max.x;b.y=min.y;b.z=min.z;
+      c.x=max.x;c.y=max.y;c.z=min.z;
+      d.x=min.x;d.y=max.y;d.z=min.z;
+      e.x=min.x;e.y=min.y;e.z=max.z;
+      f.x=max.x;f.y=min.y;f.z=max.z;
+      g.x=max.x;g.y=max.y;g.z=max.z;
+      h.x=min.x;h.y=max.y;h.z=max.z;
+
+      marker.points.push_back(a);
+      marker.points.push_back(b);
+
+      marker.points.push_back(b);
+      marker.points.push_back(c);
+
+      marker.points.push_back(c);
+      marker.points.push_back(d);
+
+      marker.points.push_back(d);
+      marker.points.push_back(a);
+
+      marker.points.push_back(e);
+      marker.points.push_back(f);
+
+      marker.points.push_back(f);
+      marker.points.push_back(g);
+
+      marker.points.push_back(g);
+      marker.points.push_back(h);
+
+      marker.points.push_back(h);
+      marker.points.push_back(e);
+
+      marker.points.push_back(a);
+      marker.points.push_back(e);
+
+      marker.points.push_back(b);
+      marker.points.push_back(f);
+
+      marker.points.push_back(c);
+      marker.points.push_back(g);
+
+      marker.points.push_back(d);
+      marker.points.push_back(h);
+
+
+    }
+    marker.color.b = 1;
+    marker.color.g = 0;
+    marker.color.r = 0;
+    marker.color.a = 1.0;
+
+    marker.lifetime = ros::Duration();
+  }
+};
@@ -0,0 +1,18 @@
+#include <nodelet/nodelet.h>
+#include <pluginlib/class_list_macros.h>
+
+#include "semantic_mapper_node.h"
+
+//semantic_mapper_node as a nodelet: loaded in the manager of the camera driver, the depth clouds are passed as
+//shared pointers instead of going through the network stack
+class SemanticMapperNodelet : public nodelet::Nodelet{
+  public:
+    virtual void onInit(){
+      _mapper.reset(new SemanticMapperNode(getPrivateNodeHandle()));
+    }
+
+  private:
+    std::unique_ptr<SemanticMapperNode> _mapper;
+};
+
+PLUGINLIB_EXPORT_CLASS(SemanticMapperNodelet,nodelet::Nodelet)
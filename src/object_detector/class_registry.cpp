@@ -0,0 +1,48 @@
+#include "class_registry.h"
+
+ClassRegistry::ClassRegistry(){}
+
+ClassRegistry::ClassRegistry(const ClassRegistry &registry){
+  *this = registry;
+}
+
+ClassRegistry &ClassRegistry::operator =(const ClassRegistry &registry){
+  if(this == &registry)
+    return *this;
+
+  std::lock(_mutex,registry._mutex);
+  std::lock_guard<std::mutex> lock(_mutex,std::adopt_lock);
+  std::lock_guard<std::mutex> other_lock(registry._mutex,std::adopt_lock);
+  _ids = registry._ids;
+  _names = registry._names;
+  _colors = registry._colors;
+  return *this;
+}
+
+int ClassRegistry::intern(const std::string &name, const Eigen::Vector3i &color){
+  std::lock_guard<std::mutex> lock(_mutex);
+  std::map<std::string,int>::const_iterator it = _ids.find(name);
+  if(it != _ids.end())
+    return it->second;
+
+  int id = _names.size();
+  _ids.insert(std::make_pair(name,id));
+  _names.push_back(name);
+  _colors.push_back(color);
+  return id;
+}
+
+int ClassRegistry::id(const std::string &name) const{
+  std::lock_guard<std::mutex> lock(_mutex);
+  std::map<std::string,int>::const_iterator it = _ids.find(name);
+  if(it == _ids.end())
+    return UNKNOWN;
+  return it->second;
+}
+
+void ClassRegistry::clear(){
+  std::lock_guard<std::mutex> lock(_mutex);
+  _ids.clear();
+  _names.clear();
+  _colors.clear();
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <memory>
+
+#include <Eigen/Core>
+#include <Eigen/StdVector>
+
+typedef std::deque<Eigen::Vector3i,Eigen::aligned_allocator<Eigen::Vector3i> > Vector3iDeque;
+
+//this class maps semantic class names to dense integer ids,
+//names are only resolved at message and file boundaries.
+//It can be shared by the detectors of several cameras: all methods are thread safe and
+//the references returned by name() and color() stay valid when new classes are interned
+class ClassRegistry{
+  public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    static const int UNKNOWN = -1;
+
+    ClassRegistry();
+
+    ClassRegistry(const ClassRegistry &registry);
+
+    ClassRegistry &operator = (const ClassRegistry &registry);
+
+    //returns the id of a class, registering it if it is not known yet
+    int intern(const std::string &name,
+               const Eigen::Vector3i &color = Eigen::Vector3i::Constant(1));
+
+    //returns the id of a class or UNKNOWN
+    int id(const std::string &name) const;
+
+    void clear();
+
+    //setters and getters
+    inline const std::string &name(int id_) const {std::lock_guard<std::mutex> lock(_mutex); return _names[id_];}
+    inline const Eigen::Vector3i &color(int id_) const {std::lock_guard<std::mutex> lock(_mutex); return _colors[id_];}
+    inline Eigen::Vector3i &color(int id_) {std::lock_guard<std::mutex> lock(_mutex); return _colors[id_];}
+    inline size_t size() const {std::lock_guard<std::mutex> lock(_mutex); return _names.size();}
+
+  private:
+    //name to id lookup, used only when parsing messages and files
+    std::map<std::string,int> _ids;
+
+    //id to name table
+    std::deque<std::string> _names;
+
+    //id to color table (only for visualization)
+    Vector3iDeque _colors;
+
+    mutable std::mutex _mutex;
+};
+
+typedef std::shared_ptr<ClassRegistry> ClassRegistryPtr;
@@ -20,16 +20,20 @@ class Detection{
     Detection();
 
     Detection(const std::string& type_,
+              const int class_id_,
               const Eigen::Vector2i& top_left_,
               const Eigen::Vector2i& bottom_right_,
               const std::vector<Eigen::Vector2i>& pixels_,
               const Eigen::Vector3i &color_);
 
-    void setup(const std::string &type, const Eigen::Vector3i& color);
+    //start a new frame, the capacity of the pixel array is kept
+    void setup(const std::string &type, const int class_id, const Eigen::Vector3i& color);
 
     //setters and getters
     inline const std::string &type() const {return _type;}
     inline std::string &type() {return _type;}
+    inline const int classId() const {return _class_id;}
+    inline int &classId() {return _class_id;}
     inline const Eigen::Vector2i &topLeft() const {return _top_left;}
     inline Eigen::Vector2i &topLeft() {return _top_left;}
     inline const Eigen::Vector2i &bottomRight() const {return _bottom_right;}
@@ -46,6 +50,9 @@ class Detection{
     //semantic class of the detected object
     std::string _type;
 
+    //dense id of the semantic class (see ClassRegistry)
+    int _class_id;
+
     //top left pixel of the image bounding box
     Eigen::Vector2i _top_left;
 
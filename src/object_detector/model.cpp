@@ -5,6 +5,7 @@ Model::Model(const std::string &type_,
              const Eigen::Vector3f &min_,
              const Eigen::Vector3f &max_):
   _type(type_),
+  _class_id(-1),
   _pose(pose_),
   _min(min_),
   _max(max_){}
@@ -27,6 +27,9 @@ class Model{
     const std::string &type() const {return _type;}
     std::string &type() {return _type;}
 
+    const int classId() const {return _class_id;}
+    int &classId() {return _class_id;}
+
     const Eigen::Isometry3f &pose() const {return _pose;}
     Eigen::Isometry3f &pose() {return _pose;}
 
@@ -41,6 +44,7 @@ class Model{
 
   private:
     std::string _type;
+    int _class_id;
     Eigen::Isometry3f _pose;
     Eigen::Vector3f _min;
     Eigen::Vector3f _max;
@@ -2,7 +2,8 @@
 
 //using namespace srrg_core;
 
-ObjectDetector::ObjectDetector(){
+ObjectDetector::ObjectDetector():
+  _registry(new ClassRegistry()){
   _camera_offset.setIdentity();
   _camera_offset.linear() = Eigen::Quaternionf(0.5,-0.5,0.5,-0.5).toRotationMatrix();
   //  _camera_offset.translation() = Eigen::Vector3f(0.0,0.0,0.6);
@@ -14,7 +15,8 @@ void ObjectDetector::setupModelColors(){
   std::string file_path = package_path + "/config/envs/" + _environment + "/object_locations.yaml";
   std::cerr << "Loading models from: " << file_path << std::endl;
 
-  //populating model colors map
+  //populating class registry
+  _registry->clear();
   int c=1;
   YAML::Node map = YAML::LoadFile(file_path);
   for(YAML::const_iterator it=map.begin(); it!=map.end(); ++it){
@@ -28,7 +30,7 @@ void ObjectDetector::setupModelColors(){
     unsigned long g_value = std::strtoul(result.substr(2,2).c_str(), 0, 16);
     unsigned long b_value = std::strtoul(result.substr(4,2).c_str(), 0, 16);
 
-    _model_colors.insert(std::make_pair(key,Eigen::Vector3i(r_value,g_value,b_value)));
+    _registry->intern(key,Eigen::Vector3i(r_value,g_value,b_value));
     c++;
   }
 }
@@ -37,12 +39,11 @@ void ObjectDetector::setupDetections(){
   if(_models.empty())
     return;
 
-  //initialize detection vector
-  _detections.clear();
+  //initialize detection vector (the pixel buffers of the previous frame are reused)
   int num_models = _models.size();
   _detections.resize(num_models);
 
-  std::vector<Eigen::Vector3f> points(2);
+  Eigen::Vector3f points[2];
   for(int i=0; i<_models.size(); ++i){
 
     //compute model bounding box in camera frame
@@ -69,13 +70,12 @@ void ObjectDetector::setupDetections(){
     _models[i].min() = min;
     _models[i].max() = max;
 
-    //setup detection
-    std::string type = _models[i].type();
-    StringVector3iMap::iterator it = _model_colors.find(type);
-    Eigen::Vector3i color = Eigen::Vector3i::Constant(1);
-    if(it != _model_colors.end())
-      color = it->second;
-    _detections[i].setup(type,color);
+    //setup detection (unknown classes get a new id and the default color)
+    const std::string &type = _models[i].type();
+    if(_models[i].classId() == ClassRegistry::UNKNOWN)
+      _models[i].classId() = _registry->intern(type);
+    const int class_id = _models[i].classId();
+    _detections[i].setup(type,class_id,_registry->color(class_id));
   }
 }
 
@@ -87,9 +87,15 @@ void ObjectDetector::compute(){
   //  Point pt;
   int h = _cloud->height;
   int w = _cloud->width;
-  for(int r=0; r<h; ++r)
-    for(int c=0; c<w; ++c){
+  const int step = _sampler.minStride();
+  const bool banded = _sampler.hasBands();
+  const Eigen::Vector3f camera_position = _camera_transform.translation();
+  for(int r=0; r<h; r+=step)
+    for(int c=0; c<w; c+=step){
       const Point &p = _cloud->at(c,r);
+
+      if(banded && !_sampler.keep(r,c,(p.getVector3fMap()-camera_position).norm()))
+        continue;
       //      pt = pcl::transformPoint(p,_camera_transform*_camera_offset);
 
       for(size_t i=0; i<_models.size(); ++i){
@@ -2,13 +2,13 @@
 
 #include "detection.h"
 #include "model.h"
+#include "class_registry.h"
+
+#include <utils/pixel_sampler.h>
 
 #include <ros/package.h>
 #include <yaml-cpp/yaml.h>
 
-typedef std::map<std::string,Eigen::Vector3i, std::less<std::string>,
-Eigen::aligned_allocator<std::pair<const std::string, Eigen::Vector3i> > > StringVector3iMap;
-
 
 //this class implements an object detector in a simulation environment
 class ObjectDetector {
@@ -17,7 +17,7 @@ class ObjectDetector {
 
     ObjectDetector();
 
-    //setup model colors
+    //setup the class registry (ids and colors) from the environment models
     void setupModelColors();
 
     //for each model the 3d bounding box is transformed in the rgbd camera frame
@@ -30,11 +30,23 @@ class ObjectDetector {
     inline void setCameraTransform(const Eigen::Isometry3f& camera_transform_){_camera_transform=camera_transform_;}
     inline void setModels(const ModelVector &models_){_models = models_;}
     inline const ModelVector &models() const {return _models;}
+    inline ModelVector &models() {return _models;}
     inline void setInputCloud(const PointCloud::ConstPtr &cloud_){_cloud=cloud_;}
     inline const DetectionVector &detections() const {return _detections;}
 
     inline std::string& environment() {return _environment;}
 
+    //pixels visited by compute (stride and distance bands)
+    inline const PixelSampler &sampler() const {return _sampler;}
+    inline PixelSampler &sampler() {return _sampler;}
+
+    inline const ClassRegistry &registry() const {return *_registry;}
+    inline ClassRegistry &registry() {return *_registry;}
+
+    //use a registry shared with other detectors (e.g. one per camera) so that class ids agree
+    inline void shareRegistry(const ClassRegistryPtr &registry_){_registry = registry_;}
+    inline const ClassRegistryPtr &sharedRegistry() const {return _registry;}
+
   protected:
 
     //camera transform
@@ -55,7 +67,10 @@ class ObjectDetector {
     //environment identifier
     std::string _environment;
 
-    //model colors map
-    StringVector3iMap _model_colors;
+    //semantic classes (ids and colors)
+    ClassRegistryPtr _registry;
+
+    //pixel sampling
+    PixelSampler _sampler;
 };
 
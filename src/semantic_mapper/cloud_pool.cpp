@@ -0,0 +1,26 @@
+#include "cloud_pool.h"
+
+CloudPool::CloudPool():
+  _allocations(0){}
+
+PointCloud::Ptr CloudPool::acquire(size_t size){
+  for(const PointCloud::Ptr &cloud : _clouds)
+    if(cloud.use_count() == 1){
+      cloud->header = pcl::PCLHeader();
+      cloud->resize(size);
+      return cloud;
+    }
+
+  _clouds.push_back(PointCloud::Ptr(new PointCloud()));
+  _allocations++;
+  _clouds.back()->resize(size);
+  return _clouds.back();
+}
+
+void CloudPool::trim(){
+  size_t k = 0;
+  for(size_t i=0; i<_clouds.size(); ++i)
+    if(_clouds[i].use_count() == 1)
+      _clouds[k++].swap(_clouds[i]);
+  _clouds.resize(k);
+}
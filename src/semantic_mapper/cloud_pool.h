@@ -0,0 +1,29 @@
+#pragma once
+
+#include <vector>
+
+#include "object.h"
+
+//this class recycles the point clouds of the local objects across frames: a cloud is handed out again
+//once nobody else holds it (the objects and the occupancy updates keep the clouds they use alive).
+//It is not thread safe, each mapper owns one
+class CloudPool{
+  public:
+    CloudPool();
+
+    //a cloud of size points that no one else holds, allocated if there is none
+    PointCloud::Ptr acquire(size_t size);
+
+    //forget the clouds still held elsewhere (e.g. by objects added to the global map), call it once per frame
+    void trim();
+
+    //setters and getters
+    inline size_t size() const {return _clouds.size();}
+    inline size_t allocations() const {return _allocations;}
+
+  private:
+    std::vector<PointCloud::Ptr> _clouds;
+
+    //clouds allocated since the pool was created
+    size_t _allocations;
+};
@@ -0,0 +1,99 @@
+#include "global_map.h"
+
+//frames between two scans for stale objects
+static const uint64_t FREEZE_PERIOD = 30;
+
+GlobalMap::GlobalMap():
+  _initialized(false),
+  _frame(0),
+  _freeze_after_frames(0),
+  _freeze_min_updates(1),
+  _frozen_objects(0),
+  _freezes(0),
+  _view(new MapView()){}
+
+void GlobalMap::restore(const ObjectPtrVector &objects){
+  if(objects.empty())
+    return;
+
+  {
+    ExclusiveLock lock(_mutex);
+    _objects.insert(_objects.end(),objects.begin(),objects.end());
+    _initialized = true;
+  }
+  publish();
+}
+
+int GlobalMap::processOccupancy(const Eigen::Vector3f &robot_position, double budget, ThreadPool *pool){
+  if(!_occupancy_scheduler.pending())
+    return 0;
+
+  SharedLock lock(_mutex);
+  return _occupancy_scheduler.process(robot_position,budget,pool);
+}
+
+void GlobalMap::updateTiles(const Eigen::Vector3f &robot_position){
+  if(!_tiles.enabled())
+    return;
+
+  //payloads are released and attached while no other camera touches the objects
+  ExclusiveLock lock(_mutex);
+  _tiles.update(&_objects,robot_position,_occupancy_scheduler);
+}
+
+int GlobalMap::freezeStale(uint64_t frame){
+  if(!_freeze_after_frames || frame % FREEZE_PERIOD)
+    return 0;
+
+  SharedLock lock(_mutex);
+  int frozen = 0;
+  size_t frozen_objects = 0;
+  for(const ObjectPtr &obj : _objects){
+    //the scheduler lock is never taken while holding an object lock
+    const bool pending = _occupancy_scheduler.isPending(obj);
+
+    std::lock_guard<std::mutex> object_lock(obj->mutex());
+    if(!obj->frozen() && !pending && obj->resident() &&
+       obj->numOccupancyUpdates() >= _freeze_min_updates &&
+       frame > obj->lastObserved()+_freeze_after_frames){
+      obj->freeze();
+      frozen++;
+    }
+    if(obj->frozen())
+      frozen_objects++;
+  }
+
+  _frozen_objects = frozen_objects;
+  _freezes += frozen;
+  return frozen;
+}
+
+void GlobalMap::publish(){
+  SharedLock lock(_mutex);
+  std::lock_guard<std::mutex> publish_lock(_publish_mutex);
+
+  const MapViewConstPtr previous = view();
+  std::shared_ptr<MapView> next(new MapView());
+  next->epoch = previous->epoch+1;
+  next->objects.reserve(_objects.size());
+
+  for(size_t i=0; i<_objects.size(); ++i){
+    const ObjectPtr &obj = _objects[i];
+    std::lock_guard<std::mutex> object_lock(obj->mutex());
+
+    //an object changes by merging, by occupancy updates, by eviction and loading or by freezing
+    if(i < previous->objects.size()){
+      const ObjectConstPtr &copy = previous->objects[i];
+      if(copy->revision() == obj->revision() &&
+         copy->numOccupancyUpdates() == obj->numOccupancyUpdates() &&
+         copy->resident() == obj->resident() &&
+         copy->frozen() == obj->frozen()){
+        next->objects.push_back(copy);
+        continue;
+      }
+    }
+    next->objects.push_back(ObjectConstPtr(new Object(*obj)));
+  }
+
+  std::atomic_store(&_view,MapViewConstPtr(next));
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+
+#include <boost/thread/shared_mutex.hpp>
+#include <boost/thread/locks.hpp>
+
+#include "object.h"
+#include "map_view.h"
+#include "occupancy_scheduler.h"
+#include "resolution_policy.h"
+#include "tile_manager.h"
+
+//this class is the global map shared by the mappers of several cameras.
+//The object vector is guarded by a readers-writer lock: association, merges and occupancy updates
+//take it shared (and lock the objects they modify), appends and whole-map operations take it exclusive.
+//Readers that do not update the map (publishers, persistence, queries) use the published snapshot
+//instead and never take these locks
+class GlobalMap{
+  public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    typedef boost::shared_mutex Mutex;
+    typedef boost::shared_lock<Mutex> SharedLock;
+    typedef boost::unique_lock<Mutex> ExclusiveLock;
+
+    GlobalMap();
+
+    //the first frame (of any camera) populates the map
+    inline bool initialized() const {return _initialized.load();}
+    inline void setInitialized() {_initialized.store(true);}
+
+    //append objects restored from disk (ownership is transferred) and publish them
+    void restore(const ObjectPtrVector &objects);
+
+    //run pending occupancy updates (on pool if not null), a negative budget runs all of them
+    //(the changes are visible to readers after the next publish)
+    int processOccupancy(const Eigen::Vector3f &robot_position, double budget, ThreadPool *pool = 0);
+
+    //evict and load tiles around the robot (if enabled)
+    void updateTiles(const Eigen::Vector3f &robot_position);
+
+    //publish a new snapshot, only the objects changed since the previous one are copied
+    void publish();
+
+    //mapper frames of all cameras, used to date the observations of the objects
+    inline uint64_t nextFrame() {return ++_frame;}
+
+    //objects not observed in the last after_frames frames (0 disables it) and integrated in at least
+    //min_updates occupancy updates are frozen (see Object::freeze)
+    inline void setFreezePolicy(uint64_t after_frames, int min_updates){
+      _freeze_after_frames = after_frames;
+      _freeze_min_updates = min_updates;
+    }
+
+    //freeze the stale objects, the map is scanned once every FREEZE_PERIOD frames.
+    //Objects with a pending occupancy update and evicted objects are skipped. Returns the number of frozen objects
+    int freezeStale(uint64_t frame);
+
+    //latest published snapshot, it stays valid as long as the caller holds it
+    inline MapViewConstPtr view() const {return std::atomic_load(&_view);}
+
+    //setters and getters
+    inline Mutex &mutex() const {return _mutex;}
+    inline const ObjectPtrVector *objects() const {return &_objects;}
+    inline ObjectPtrVector *objects() {return &_objects;}
+    inline const OccupancyScheduler &occupancyScheduler() const {return _occupancy_scheduler;}
+    inline OccupancyScheduler &occupancyScheduler() {return _occupancy_scheduler;}
+    inline const TileManager &tiles() const {return _tiles;}
+    inline TileManager &tiles() {return _tiles;}
+    inline const ResolutionPolicy &resolutionPolicy() const {return _resolution_policy;}
+    inline ResolutionPolicy &resolutionPolicy() {return _resolution_policy;}
+    inline size_t frozenObjects() const {return _frozen_objects;}
+    inline size_t freezes() const {return _freezes;}
+
+  protected:
+    ObjectPtrVector _objects;
+    std::atomic<bool> _initialized;
+    mutable Mutex _mutex;
+
+    //deferred occupancy updates
+    OccupancyScheduler _occupancy_scheduler;
+
+    //evicted tiles
+    TileManager _tiles;
+
+    //octree resolution of new objects (configured before the cameras start)
+    ResolutionPolicy _resolution_policy;
+
+    //frozen tier
+    std::atomic<uint64_t> _frame;
+    uint64_t _freeze_after_frames;
+    int _freeze_min_updates;
+    std::atomic<size_t> _frozen_objects;
+    std::atomic<size_t> _freezes;
+
+    //latest snapshot, replaced atomically (one publisher at a time)
+    MapViewConstPtr _view;
+    std::mutex _publish_mutex;
+};
+
+typedef std::shared_ptr<GlobalMap> GlobalMapPtr;
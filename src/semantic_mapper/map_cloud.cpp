@@ -0,0 +1,92 @@
+#include "map_cloud.h"
+
+#include <limits>
+
+MapCloud::MapCloud():
+  _cloud(new PointCloud()),
+  _num_points(0){
+  _cloud->header.frame_id = "/map";
+  _cloud->height = 1;
+  _cloud->width = 0;
+  _cloud->is_dense = false;
+}
+
+void MapCloud::clear(){
+  _segments.clear();
+  _cloud->points.clear();
+  _cloud->width = 0;
+  _num_points = 0;
+}
+
+void MapCloud::fill(size_t begin, size_t end){
+  const float nan = std::numeric_limits<float>::quiet_NaN();
+  Point *points = _cloud->points.data();
+  for(size_t j=begin; j<end; ++j){
+    points[j].x = nan;
+    points[j].y = nan;
+    points[j].z = nan;
+  }
+}
+
+void MapCloud::copyObject(const Object &object, size_t offset){
+  const Eigen::Vector3f &color = object.color();
+  const uint8_t r = color.z()*255;
+  const uint8_t g = color.y()*255;
+  const uint8_t b = color.x()*255;
+
+  //decoded in place
+  Point *points = _cloud->points.data()+offset;
+  object.copyCloud(points);
+  for(size_t j=0; j < object.numPoints(); ++j){
+    Point &point = points[j];
+    point.r = r;
+    point.g = g;
+    point.b = b;
+  }
+}
+
+bool MapCloud::update(const MapView &view){
+  const ObjectConstPtrVector &objects = view.objects;
+  const size_t num_objects = objects.size();
+
+  //objects are never removed from the map, a smaller one is a new map. The cloud is also rebuilt
+  //once the unused points exceed the used ones
+  if(num_objects < _segments.size() || _cloud->points.size() > 2*_num_points)
+    clear();
+  _segments.resize(num_objects);
+
+  bool changed = false;
+  for(size_t i=0; i<num_objects; ++i){
+    Segment &segment = _segments[i];
+    if(segment.object == objects[i])
+      continue;
+
+    const size_t size = objects[i]->numPoints();
+    if(!segment.object || size > segment.capacity){
+      //the old slice is left empty, the object moves to the end with some room to grow
+      fill(segment.offset,segment.offset+segment.size);
+      segment.offset = _cloud->points.size();
+      segment.capacity = size+size/4;
+
+      //grow geometrically so that objects added every frame do not reallocate every frame
+      const size_t end = segment.offset+segment.capacity;
+      if(end > _cloud->points.capacity())
+        _cloud->points.reserve(end + end/2);
+      _cloud->points.resize(end);
+      fill(segment.offset+size,end);
+    } else if(size < segment.size){
+      fill(segment.offset+size,segment.offset+segment.size);
+    }
+
+    _num_points += size;
+    _num_points -= segment.size;
+    segment.object = objects[i];
+    segment.size = size;
+    copyObject(*segment.object,segment.offset);
+    changed = true;
+  }
+
+  _cloud->width = _cloud->points.size();
+  _cloud->height = 1;
+  return changed;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <vector>
+
+#include "map_view.h"
+
+//this class maintains the aggregate cloud of a map snapshot (one color per object):
+//only the objects whose copy changed since the previous snapshot are copied again.
+//Each object owns a slice with room to grow, an object that outgrows it moves to the end of the
+//cloud. Unused points are NaN, the cloud is compacted when they exceed the used ones
+class MapCloud{
+  public:
+    MapCloud();
+
+    //bring the aggregate cloud up to date, returns true if it changed
+    bool update(const MapView &view);
+
+    inline const PointCloud::Ptr &cloud() const {return _cloud;}
+
+    //drop the cached segments, the next update rebuilds the whole cloud
+    void clear();
+
+  private:
+    //slice of the aggregate cloud that holds an object (the copy is held to compare it with the next snapshot)
+    struct Segment{
+      Segment():offset(0),size(0),capacity(0){}
+      ObjectConstPtr object;
+      size_t offset;
+      size_t size;
+      size_t capacity;
+    };
+
+    void copyObject(const Object &object, size_t offset);
+
+    //set the points in [begin,end) to NaN
+    void fill(size_t begin, size_t end);
+
+    std::vector<Segment> _segments;
+    PointCloud::Ptr _cloud;
+
+    //points of the objects (the other points of the cloud are NaN)
+    size_t _num_points;
+};
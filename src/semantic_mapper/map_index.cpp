@@ -0,0 +1,216 @@
+#include "map_index.h"
+
+#include <algorithm>
+#include <limits>
+#include <cmath>
+
+//objects per leaf
+static const int LEAF_SIZE = 4;
+
+MapIndex::MapIndex(const MapViewConstPtr &view):
+  _view(view),
+  _margin(0){
+
+  const ObjectConstPtrVector &objects = _view->objects;
+  const int num_objects = objects.size();
+
+  _boxes.resize(num_objects);
+  _items.resize(num_objects);
+  for(int i=0; i<num_objects; ++i){
+    const Object &obj = *objects[i];
+    Box &box = _boxes[i];
+    box.min = obj.min();
+    box.max = obj.max();
+    box.center = (box.min+box.max)*0.5f;
+    _items[i] = i;
+    _margin = std::max(_margin,(float)obj.resolution());
+
+    if(obj.classId() < 0)
+      continue;
+    if(obj.classId() >= (int)_classes.size())
+      _classes.resize(obj.classId()+1);
+    _classes[obj.classId()].push_back(i);
+  }
+
+  if(num_objects){
+    _nodes.reserve(2*num_objects/LEAF_SIZE+1);
+    build(0,num_objects);
+  }
+}
+
+int MapIndex::build(int begin, int end){
+  const int index = _nodes.size();
+  _nodes.push_back(Node());
+
+  Eigen::Vector3f min = _boxes[_items[begin]].min;
+  Eigen::Vector3f max = _boxes[_items[begin]].max;
+  Eigen::Vector3f center_min = _boxes[_items[begin]].center;
+  Eigen::Vector3f center_max = center_min;
+  for(int i=begin+1; i<end; ++i){
+    const Box &box = _boxes[_items[i]];
+    min = min.cwiseMin(box.min);
+    max = max.cwiseMax(box.max);
+    center_min = center_min.cwiseMin(box.center);
+    center_max = center_max.cwiseMax(box.center);
+  }
+  _nodes[index].min = min;
+  _nodes[index].max = max;
+  _nodes[index].begin = begin;
+  _nodes[index].end = end;
+  _nodes[index].right = -1;
+
+  if(end-begin <= LEAF_SIZE)
+    return index;
+
+  //split at the median center along the axis with the largest spread
+  int axis;
+  (center_max-center_min).maxCoeff(&axis);
+  const int middle = begin+(end-begin)/2;
+  std::nth_element(_items.begin()+begin,_items.begin()+middle,_items.begin()+end,
+                   [this,axis](int a, int b){return _boxes[a].center[axis] < _boxes[b].center[axis];});
+
+  build(begin,middle);
+  const int right = build(middle,end);
+  _nodes[index].right = right;
+  return index;
+}
+
+float MapIndex::squaredDistance(const Eigen::Vector3f &point, const Eigen::Vector3f &min, const Eigen::Vector3f &max){
+  const Eigen::Vector3f d = (min-point).cwiseMax(point-max).cwiseMax(Eigen::Vector3f::Zero());
+  return d.squaredNorm();
+}
+
+int MapIndex::nearest(const Eigen::Vector3f &point, int class_id, float &distance) const{
+  int best = -1;
+  float best_distance = std::numeric_limits<float>::max();
+
+  //class buckets are small, scan them
+  if(class_id != ANY){
+    if(class_id < 0 || class_id >= (int)_classes.size())
+      return -1;
+    for(int i : _classes[class_id]){
+      const float d = squaredDistance(point,_boxes[i].min,_boxes[i].max);
+      if(d < best_distance){
+        best_distance = d;
+        best = i;
+      }
+    }
+    distance = std::sqrt(best_distance);
+    return best;
+  }
+
+  if(_nodes.empty())
+    return -1;
+
+  //depth first, nearest child first, pruning the nodes farther than the best object
+  int stack[64];
+  int top = 0;
+  stack[top++] = 0;
+  while(top){
+    const int index = stack[--top];
+    const Node &node = _nodes[index];
+    if(squaredDistance(point,node.min,node.max) >= best_distance)
+      continue;
+
+    if(node.leaf()){
+      for(int k=node.begin; k<node.end; ++k){
+        const int i = _items[k];
+        const float d = squaredDistance(point,_boxes[i].min,_boxes[i].max);
+        if(d < best_distance){
+          best_distance = d;
+          best = i;
+        }
+      }
+      continue;
+    }
+
+    const int left = index+1;
+    const int right = node.right;
+    const float left_distance = squaredDistance(point,_nodes[left].min,_nodes[left].max);
+    const float right_distance = squaredDistance(point,_nodes[right].min,_nodes[right].max);
+    if(left_distance < right_distance){
+      stack[top++] = right;
+      stack[top++] = left;
+    } else {
+      stack[top++] = left;
+      stack[top++] = right;
+    }
+  }
+
+  distance = std::sqrt(best_distance);
+  return best;
+}
+
+void MapIndex::inRegion(const Eigen::Vector3f &min, const Eigen::Vector3f &max, int class_id, std::vector<int> &result) const{
+  result.clear();
+  if(_nodes.empty())
+    return;
+
+  int stack[64];
+  int top = 0;
+  stack[top++] = 0;
+  while(top){
+    const int index = stack[--top];
+    const Node &node = _nodes[index];
+    if((node.min.array() > max.array()).any() || (node.max.array() < min.array()).any())
+      continue;
+
+    if(!node.leaf()){
+      stack[top++] = node.right;
+      stack[top++] = index+1;
+      continue;
+    }
+
+    for(int k=node.begin; k<node.end; ++k){
+      const int i = _items[k];
+      const Box &box = _boxes[i];
+      if((box.min.array() > max.array()).any() || (box.max.array() < min.array()).any())
+        continue;
+      if(class_id != ANY && _view->objects[i]->classId() != class_id)
+        continue;
+      result.push_back(i);
+    }
+  }
+}
+
+int MapIndex::occupied(const Eigen::Vector3f &point, float &probability) const{
+  if(_nodes.empty())
+    return -1;
+
+  int stack[64];
+  int top = 0;
+  stack[top++] = 0;
+  while(top){
+    const int index = stack[--top];
+    const Node &node = _nodes[index];
+
+    if((node.min.array()-_margin > point.array()).any() || (node.max.array()+_margin < point.array()).any())
+      continue;
+
+    if(!node.leaf()){
+      stack[top++] = node.right;
+      stack[top++] = index+1;
+      continue;
+    }
+
+    for(int k=node.begin; k<node.end; ++k){
+      const int i = _items[k];
+      const Object &obj = *_view->objects[i];
+      if(!obj.resident())
+        continue;
+
+      //the voxels may stick out of the box by less than one voxel
+      const float margin = obj.resolution();
+      const Box &box = _boxes[i];
+      if((box.min.array()-margin > point.array()).any() || (box.max.array()+margin < point.array()).any())
+        continue;
+
+      float occupancy;
+      if(obj.occupancy(octomap::point3d(point.x(),point.y(),point.z()),occupancy) && occupancy >= 0.5f){
+        probability = occupancy;
+        return i;
+      }
+    }
+  }
+  return -1;
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+
+#include <Eigen/StdVector>
+
+#include "map_view.h"
+
+//this class answers spatial and semantic queries on a map snapshot:
+//objects are bucketed by class and their bounding boxes are stored in an AABB tree
+//(flat array, median split on the longest axis), occupancy is read from the object octrees.
+//An index is immutable once built, it holds the snapshot so it can be shared by concurrent queries
+class MapIndex{
+  public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    //any class
+    static const int ANY = -1;
+
+    MapIndex(const MapViewConstPtr &view);
+
+    //index of the object of class class_id (or ANY) whose bounding box is closest to point, -1 if none.
+    //distance is 0 if the point falls inside the box
+    int nearest(const Eigen::Vector3f &point, int class_id, float &distance) const;
+
+    //indices of the objects of class class_id (or ANY) whose bounding box overlaps the region
+    void inRegion(const Eigen::Vector3f &min, const Eigen::Vector3f &max, int class_id, std::vector<int> &result) const;
+
+    //index of the object with an occupied voxel at point, -1 if none.
+    //Evicted objects have no voxels and never occupy a point
+    int occupied(const Eigen::Vector3f &point, float &probability) const;
+
+    //setters and getters
+    inline const MapViewConstPtr &view() const {return _view;}
+    inline uint64_t epoch() const {return _view->epoch;}
+    inline const Object &object(int index) const {return *_view->objects[index];}
+    inline size_t size() const {return _view->objects.size();}
+
+  protected:
+
+    //inner nodes have two children (left is the next node, right is stored),
+    //leaves hold the range [begin,end) of _items
+    struct Node{
+      EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+      Eigen::Vector3f min;
+      Eigen::Vector3f max;
+      int right;
+      int begin;
+      int end;
+      inline bool leaf() const {return right < 0;}
+    };
+    typedef std::vector<Node,Eigen::aligned_allocator<Node> > NodeVector;
+
+    struct Box{
+      EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+      Eigen::Vector3f min;
+      Eigen::Vector3f max;
+      Eigen::Vector3f center;
+    };
+    typedef std::vector<Box,Eigen::aligned_allocator<Box> > BoxVector;
+
+    //builds the subtree over _items[begin,end) and returns its node
+    int build(int begin, int end);
+
+    static float squaredDistance(const Eigen::Vector3f &point, const Eigen::Vector3f &min, const Eigen::Vector3f &max);
+
+    MapViewConstPtr _view;
+
+    //object boxes by object index
+    BoxVector _boxes;
+
+    //object indices ordered by the tree leaves
+    std::vector<int> _items;
+
+    NodeVector _nodes;
+
+    //largest voxel size, bound on how far occupied voxels stick out of the boxes
+    float _margin;
+
+    //object indices by class id
+    std::vector<std::vector<int> > _classes;
+};
+
+typedef std::shared_ptr<const MapIndex> MapIndexConstPtr;
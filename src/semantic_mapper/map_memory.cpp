@@ -0,0 +1,46 @@
+#include "map_memory.h"
+
+#include <algorithm>
+
+MapMemory::MapMemory(const GlobalMap &map){
+  GlobalMap::SharedLock lock(map.mutex());
+  const ObjectPtrVector &objects = *map.objects();
+  _objects.resize(objects.size());
+  for(size_t i=0; i<objects.size(); ++i){
+    const ObjectPtr &obj = objects[i];
+    Entry &entry = _objects[i];
+    std::lock_guard<std::mutex> object_lock(obj->mutex());
+    entry.model = obj->model();
+    entry.class_id = obj->classId();
+    entry.resident = obj->resident();
+    entry.memory = obj->memoryUsage();
+    _total += entry.memory;
+  }
+}
+
+std::vector<int> MapMemory::top(size_t n) const{
+  std::vector<int> indices(_objects.size());
+  for(size_t i=0; i<indices.size(); ++i)
+    indices[i] = i;
+
+  if(!n || n > indices.size())
+    n = indices.size();
+  std::partial_sort(indices.begin(),indices.begin()+n,indices.end(),
+                    [this](int a, int b){return _objects[a].memory.total() > _objects[b].memory.total();});
+  indices.resize(n);
+  return indices;
+}
+
+void MapMemory::write(std::ostream &stream, size_t n) const{
+  stream << "object,class,resident,cloud,occupancy,voxel_clouds,total" << std::endl;
+  stream << "total,,,"
+         << _total.cloud << "," << _total.occupancy << "," << _total.voxel_clouds << ","
+         << _total.total() << std::endl;
+  for(int i : top(n)){
+    const Entry &entry = _objects[i];
+    const ObjectMemory &memory = entry.memory;
+    stream << entry.model << "," << entry.class_id << "," << entry.resident << ","
+           << memory.cloud << "," << memory.occupancy << "," << memory.voxel_clouds << ","
+           << memory.total() << std::endl;
+  }
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "global_map.h"
+
+//this class accounts the memory used by the objects of the global map.
+//The live objects are measured (snapshot copies share their payloads), each under its own lock
+class MapMemory{
+  public:
+    MapMemory(const GlobalMap &map);
+
+    struct Entry{
+      std::string model;
+      int class_id;
+      bool resident;
+      ObjectMemory memory;
+    };
+
+    //indices of the n objects that use most memory, largest first (all of them if n is 0)
+    std::vector<int> top(size_t n) const;
+
+    //csv report: totals, then one line per object of top(n)
+    void write(std::ostream &stream, size_t n = 0) const;
+
+    //setters and getters
+    inline const ObjectMemory &total() const {return _total;}
+    inline const Entry &object(int index) const {return _objects[index];}
+    inline size_t size() const {return _objects.size();}
+
+  private:
+    std::vector<Entry> _objects;
+    ObjectMemory _total;
+};
@@ -0,0 +1,356 @@
+#include "map_persistence.h"
+
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace {
+
+  const char SNAPSHOT_MAGIC[8] = "LSMSNAP";
+  const char JOURNAL_MAGIC[8] = "LSMJRNL";
+  const uint32_t FORMAT_VERSION = 4;
+
+  struct FileHeader{
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t epoch;
+    uint64_t num_objects;
+  };
+
+  FileHeader makeHeader(const char *magic, uint64_t epoch, uint64_t num_objects){
+    FileHeader header;
+    memcpy(header.magic,magic,8);
+    header.version = FORMAT_VERSION;
+    header.reserved = 0;
+    header.epoch = epoch;
+    header.num_objects = num_objects;
+    return header;
+  }
+
+  bool validHeader(const FileHeader &header, const char *magic){
+    return !memcmp(header.magic,magic,8) && header.version == FORMAT_VERSION;
+  }
+
+  //read-only memory mapping of a whole file
+  class MappedFile{
+    public:
+      MappedFile(const std::string &filename):_data(0),_size(0){
+        int fd = open(filename.c_str(),O_RDONLY);
+        if(fd < 0)
+          return;
+        struct stat st;
+        if(!fstat(fd,&st) && st.st_size > 0){
+          void *data = mmap(0,st.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+          if(data != MAP_FAILED){
+            _data = static_cast<const char*>(data);
+            _size = st.st_size;
+            madvise(data,_size,MADV_SEQUENTIAL);
+          }
+        }
+        close(fd);
+      }
+
+      ~MappedFile(){
+        if(_data)
+          munmap(const_cast<char*>(_data),_size);
+      }
+
+      inline const char *begin() const {return _data;}
+      inline const char *end() const {return _data+_size;}
+      inline size_t size() const {return _size;}
+
+    private:
+      const char *_data;
+      size_t _size;
+  };
+
+  void syncFile(FILE *file){
+    fflush(file);
+    fsync(fileno(file));
+  }
+
+}
+
+MapPersistence::MapPersistence(){
+  _registry = 0;
+  _epoch = 0;
+  _journal = 0;
+  _running = false;
+  _busy = false;
+}
+
+MapPersistence::~MapPersistence(){
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _running = false;
+  }
+  _condition.notify_all();
+  if(_thread.joinable())
+    _thread.join();
+  if(_journal)
+    fclose(_journal);
+}
+
+void MapPersistence::setup(const std::string &directory, const ClassRegistry *registry){
+  _directory = directory;
+  if(!_directory.empty() && _directory[_directory.size()-1] != '/')
+    _directory += "/";
+  _registry = registry;
+
+  std::lock_guard<std::mutex> lock(_mutex);
+  if(_running || _directory.empty())
+    return;
+  _running = true;
+  _thread = std::thread(&MapPersistence::run,this);
+}
+
+void MapPersistence::appendObject(std::string &buffer, const Object &obj) const{
+  const std::string class_name = obj.classId() >= 0 ? _registry->name(obj.classId()) : std::string();
+  const uint32_t size = class_name.size();
+  buffer.append(reinterpret_cast<const char*>(&size),sizeof(size));
+  buffer.append(class_name);
+  obj.writeBinary(buffer);
+}
+
+bool MapPersistence::readObject(const char* &data, const char *end, ClassRegistry &registry, ObjectPtr &obj) const{
+  uint32_t size;
+  if(end-data < (ptrdiff_t)sizeof(size))
+    return false;
+  memcpy(&size,data,sizeof(size));
+  data += sizeof(size);
+  if((uint32_t)(end-data) < size)
+    return false;
+  const std::string class_name(data,size);
+  data += size;
+
+  obj = new Object();
+  if(!obj->readBinary(data,end)){
+    delete obj;
+    obj = 0;
+    return false;
+  }
+  obj->classId() = class_name.empty() ? ClassRegistry::UNKNOWN : registry.intern(class_name);
+  return true;
+}
+
+bool MapPersistence::load(ClassRegistry &registry, ObjectPtrVector &objects){
+  if(!enabled())
+    return false;
+
+  //without a snapshot the journal would have no base to be replayed on,
+  //an empty one is written first
+  MappedFile snapshot(_directory+"map.snap");
+  FileHeader header;
+  if(snapshot.size() < sizeof(FileHeader)){
+    recordSnapshot(MapView());
+    return false;
+  }
+
+  memcpy(&header,snapshot.begin(),sizeof(FileHeader));
+  if(!validHeader(header,SNAPSHOT_MAGIC)){
+    std::cerr << "[MapPersistence] invalid snapshot " << _directory << "map.snap" << std::endl;
+    recordSnapshot(MapView());
+    return false;
+  }
+
+  const char *data = snapshot.begin()+sizeof(FileHeader);
+  for(uint64_t i=0; i<header.num_objects; ++i){
+    ObjectPtr obj;
+    if(!readObject(data,snapshot.end(),registry,obj)){
+      std::cerr << "[MapPersistence] truncated snapshot, " << i << " objects loaded" << std::endl;
+      break;
+    }
+    objects.push_back(obj);
+  }
+  _epoch = header.epoch;
+
+  //replay the journal written after this snapshot, stopping at the first incomplete record
+  size_t replayed = 0;
+  bool journal_valid = false;
+  {
+    MappedFile journal(_directory+"map.journal");
+    FileHeader journal_header;
+    if(journal.size() >= sizeof(FileHeader)){
+      memcpy(&journal_header,journal.begin(),sizeof(FileHeader));
+      journal_valid = validHeader(journal_header,JOURNAL_MAGIC) && journal_header.epoch == _epoch;
+    }
+
+    data = journal_valid ? journal.begin()+sizeof(FileHeader) : journal.end();
+    while(journal_valid && journal.end()-data >= (ptrdiff_t)(2*sizeof(uint64_t))){
+      uint64_t index, size;
+      memcpy(&index,data,sizeof(index));
+      memcpy(&size,data+sizeof(index),sizeof(size));
+      const char *record = data+2*sizeof(uint64_t);
+      if((uint64_t)(journal.end()-record) < size || index > objects.size())
+        break;
+
+      const char *record_end = record+size;
+      ObjectPtr obj;
+      if(!readObject(record,record_end,registry,obj))
+        break;
+      if(index == objects.size()){
+        objects.push_back(obj);
+      } else {
+        delete objects[index];
+        objects[index] = obj;
+      }
+      data = record_end;
+      replayed++;
+    }
+  }
+
+  //loaded objects are already on disk
+  _persisted.clear();
+  for(const ObjectPtr &obj : objects)
+    _persisted.push_back(state(*obj));
+
+  if(journal_valid){
+    _journal = fopen((_directory+"map.journal").c_str(),"ab");
+  }
+
+  std::cerr << "[MapPersistence] resumed " << objects.size() << " objects (epoch " << _epoch
+            << ", " << replayed << " journal records)" << std::endl;
+  return true;
+}
+
+void MapPersistence::recordChanges(const MapView &view){
+  if(!enabled())
+    return;
+
+  Job job;
+  job.snapshot = false;
+  job.epoch = _epoch;
+  job.num_objects = 0;
+
+  //objects are never removed from the map, new ones have no persisted state yet
+  const ObjectConstPtrVector &objects = view.objects;
+  if(_persisted.size() < objects.size())
+    _persisted.resize(objects.size(),ObjectState(-1,-1));
+
+  std::string record;
+  for(uint64_t i=0; i<objects.size(); ++i){
+    const Object &obj = *objects[i];
+    const ObjectState current = state(obj);
+    if(_persisted[i] == current)
+      continue;
+    _persisted[i] = current;
+
+    record.clear();
+    appendObject(record,obj);
+    const uint64_t size = record.size();
+    job.data.append(reinterpret_cast<const char*>(&i),sizeof(i));
+    job.data.append(reinterpret_cast<const char*>(&size),sizeof(size));
+    job.data.append(record);
+    job.num_objects++;
+  }
+
+  if(job.num_objects)
+    push(job);
+}
+
+void MapPersistence::recordSnapshot(const MapView &view){
+  if(!enabled())
+    return;
+
+  Job job;
+  job.snapshot = true;
+  job.epoch = ++_epoch;
+  job.num_objects = view.objects.size();
+  _persisted.resize(view.objects.size());
+  for(size_t i=0; i<view.objects.size(); ++i){
+    appendObject(job.data,*view.objects[i]);
+    _persisted[i] = state(*view.objects[i]);
+  }
+  push(job);
+}
+
+void MapPersistence::flush(){
+  std::unique_lock<std::mutex> lock(_mutex);
+  while(_running && (_busy || !_jobs.empty()))
+    _condition.wait(lock);
+}
+
+void MapPersistence::push(Job &job){
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _jobs.push_back(Job());
+    _jobs.back().snapshot = job.snapshot;
+    _jobs.back().epoch = job.epoch;
+    _jobs.back().num_objects = job.num_objects;
+    _jobs.back().data.swap(job.data);
+  }
+  _condition.notify_all();
+}
+
+void MapPersistence::openJournal(uint64_t epoch){
+  if(_journal)
+    fclose(_journal);
+  _journal = fopen((_directory+"map.journal").c_str(),"wb");
+  if(!_journal){
+    std::cerr << "[MapPersistence] cannot open " << _directory << "map.journal" << std::endl;
+    return;
+  }
+  FileHeader header = makeHeader(JOURNAL_MAGIC,epoch,0);
+  fwrite(&header,sizeof(header),1,_journal);
+  syncFile(_journal);
+}
+
+void MapPersistence::writeSnapshot(const Job &job){
+  const std::string filename = _directory+"map.snap";
+  const std::string tmp_filename = filename+".tmp";
+  FILE *file = fopen(tmp_filename.c_str(),"wb");
+  if(!file){
+    std::cerr << "[MapPersistence] cannot open " << tmp_filename << std::endl;
+    return;
+  }
+  FileHeader header = makeHeader(SNAPSHOT_MAGIC,job.epoch,job.num_objects);
+  bool ok = fwrite(&header,sizeof(header),1,file) == 1 &&
+      fwrite(job.data.data(),1,job.data.size(),file) == job.data.size();
+  syncFile(file);
+  fclose(file);
+
+  //the new snapshot replaces the old one atomically, then the journal restarts
+  if(ok && !rename(tmp_filename.c_str(),filename.c_str()))
+    openJournal(job.epoch);
+  else
+    std::cerr << "[MapPersistence] cannot write " << filename << std::endl;
+}
+
+void MapPersistence::run(){
+  std::unique_lock<std::mutex> lock(_mutex);
+  while(_running || !_jobs.empty()){
+    if(_jobs.empty()){
+      _condition.wait(lock);
+      continue;
+    }
+
+    Job job;
+    job.snapshot = _jobs.front().snapshot;
+    job.epoch = _jobs.front().epoch;
+    job.num_objects = _jobs.front().num_objects;
+    job.data.swap(_jobs.front().data);
+    _jobs.pop_front();
+    _busy = true;
+    lock.unlock();
+
+    if(job.snapshot){
+      writeSnapshot(job);
+    } else {
+      if(!_journal)
+        openJournal(job.epoch);
+      if(_journal){
+        fwrite(job.data.data(),1,job.data.size(),_journal);
+        syncFile(_journal);
+      }
+    }
+
+    lock.lock();
+    _busy = false;
+    _condition.notify_all();
+  }
+}
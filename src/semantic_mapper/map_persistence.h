@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdint>
+#include <string>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include <object_detector/class_registry.h>
+
+#include "object.h"
+#include "map_view.h"
+
+//this class persists the global map as a versioned binary snapshot (map.snap) plus a journal of the
+//objects changed since that snapshot (map.journal). Records are serialized from a map snapshot
+//by the caller and written to disk by a background thread
+class MapPersistence{
+  public:
+    MapPersistence();
+
+    ~MapPersistence();
+
+    //directory of the snapshot and journal files, starts the writer thread
+    void setup(const std::string &directory, const ClassRegistry *registry);
+
+    inline bool enabled() const {return !_directory.empty();}
+
+    //memory-map the snapshot and replay the journal on top of it,
+    //class names are interned in registry. Returns false if there is nothing to resume,
+    //in which case an empty snapshot is queued as the base of the journal
+    bool load(ClassRegistry &registry, ObjectPtrVector &objects);
+
+    //queue a journal record for every object changed since the last record or snapshot
+    void recordChanges(const MapView &view);
+
+    //queue a full snapshot, the journal restarts after it is written
+    void recordSnapshot(const MapView &view);
+
+    //wait until the queued writes are on disk
+    void flush();
+
+  protected:
+
+    struct Job{
+      bool snapshot;
+      uint64_t epoch;
+      uint64_t num_objects;
+      std::string data;
+    };
+
+    //persisted state of an object: geometry revision and number of occupancy updates
+    typedef std::pair<int,int> ObjectState;
+
+    inline ObjectState state(const Object &obj) const {return ObjectState(obj.revision(),obj.numOccupancyUpdates());}
+
+    //class name followed by the object record
+    void appendObject(std::string &buffer, const Object &obj) const;
+    bool readObject(const char* &data, const char *end, ClassRegistry &registry, ObjectPtr &obj) const;
+
+    void push(Job &job);
+    void run();
+    void writeSnapshot(const Job &job);
+    void openJournal(uint64_t epoch);
+
+    std::string _directory;
+    const ClassRegistry *_registry;
+
+    //last persisted state of each object (by index in the map)
+    std::vector<ObjectState> _persisted;
+
+    //snapshot counter, the journal is valid only for the snapshot with the same epoch
+    uint64_t _epoch;
+
+    FILE *_journal;
+
+    std::deque<Job> _jobs;
+    bool _running;
+    bool _busy;
+    std::mutex _mutex;
+    std::condition_variable _condition;
+    std::thread _thread;
+};
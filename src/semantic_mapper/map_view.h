@@ -0,0 +1,24 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "object.h"
+
+typedef std::shared_ptr<const Object> ObjectConstPtr;
+typedef std::vector<ObjectConstPtr> ObjectConstPtrVector;
+
+//immutable snapshot of the global map: object i is a copy of the i-th object of the map when the
+//snapshot was published. Copies of unchanged objects are shared between consecutive snapshots and
+//their clouds and octree with the live objects (see Object), a retired copy is reclaimed when
+//the last snapshot that holds it is released
+struct MapView{
+  MapView():epoch(0){}
+
+  //incremented by every publication
+  uint64_t epoch;
+
+  ObjectConstPtrVector objects;
+};
+
+typedef std::shared_ptr<const MapView> MapViewConstPtr;
@@ -1,5 +1,12 @@
 #include "object.h"
 
+#include <sstream>
+#include <fstream>
+#include <iterator>
+#include <cstring>
+#include <streambuf>
+#include <algorithm>
+
 namespace YAML {
   template <typename Scalar, int Rows, int Cols>
   struct convert<Eigen::Matrix<Scalar,Rows,Cols> > {
@@ -62,7 +69,7 @@ namespace YAML {
       node["max"] = obj.max();
       const std::string cloud_filename = model+".pcd";
       node["cloud"] = cloud_filename;
-      pcl::io::savePCDFileASCII(cloud_filename,*(obj.cloud()));
+      pcl::io::savePCDFileASCII(cloud_filename,*(obj.fullCloud()));
       return node;
     }
 
@@ -74,7 +81,9 @@ namespace YAML {
       obj.min() = node["min"].as<Eigen::Vector3f>();
       obj.max() = node["max"].as<Eigen::Vector3f>();
       const std::string cloud_filename = node["cloud"].as<std::string>();
-      pcl::io::loadPCDFile<Point> (cloud_filename, *(obj.cloud()));
+      PointCloud::Ptr cloud(new PointCloud());
+      pcl::io::loadPCDFile<Point> (cloud_filename, *cloud);
+      obj.setCloud(cloud);
       return true;
     }
   };
@@ -82,16 +91,49 @@ namespace YAML {
 
 using namespace std;
 
-Object::Object():_octree(new octomap::OcTree(0.05)){ //0.05
+//quantization step of object clouds, well below the merge leaf
+static const float CLOUD_STEP = 0.001f;
+
+namespace {
+
+  std::shared_ptr<const QuantizedCloud> quantize(const PointCloud &cloud, float step){
+    std::shared_ptr<QuantizedCloud> quantized(new QuantizedCloud());
+    quantized->encode(cloud,step);
+    return quantized;
+  }
+
+  //voxel centers lie on the grid of half the voxel size (pruned voxels included), they are stored exactly
+  inline std::shared_ptr<const QuantizedCloud> quantizeVoxels(const PointCloud &cloud, double resolution){
+    return quantize(cloud,resolution/2);
+  }
+
+  PointCloud::Ptr decode(const std::shared_ptr<const QuantizedCloud> &quantized){
+    PointCloud::Ptr cloud(new PointCloud());
+    if(quantized)
+      quantized->decode(*cloud);
+    return cloud;
+  }
+
+}
+
+Object::Object(){
   _model = "";
+  _resolution = 0.05;
+  _leaf_size = 0.02f;
+  _class_id = -1;
   _position.setZero();
   _min.setZero();
   _max.setZero();
   _color.setZero();
   _cloud = PointCloud::Ptr (new PointCloud());
-  _fre_voxel_cloud = PointCloud::Ptr (new PointCloud());
-  _occ_voxel_cloud = PointCloud::Ptr (new PointCloud());
   _ocupancy_volume = 0.0;
+  _num_occupancy_updates = 0;
+  _revision = 0;
+  _last_processed_orientation.setIdentity();
+  _num_fre_voxels = 0;
+  _num_occ_voxels = 0;
+  _frozen = false;
+  _last_observed = 0;
 }
 
 Object::Object(const string &model_,
@@ -101,14 +143,23 @@ Object::Object(const string &model_,
                const Eigen::Vector3f &color_,
                const PointCloud::Ptr & cloud_):
   _model(model_),
+  _class_id(-1),
   _position(position_),
   _min(min_),
   _max(max_),
   _color(color_),
   _cloud(cloud_),
-  _octree(new octomap::OcTree(0.05)),
-  _fre_voxel_cloud(new PointCloud()),
-  _occ_voxel_cloud(new PointCloud()){_ocupancy_volume= 0.0;}
+  _leaf_size(0.02f),
+  _resolution(0.05),
+  _num_occ_voxels(0),
+  _num_fre_voxels(0),
+  _frozen(false),
+  _last_observed(0){
+  _ocupancy_volume= 0.0;
+  _num_occupancy_updates = 0;
+  _revision = 0;
+  _last_processed_orientation.setIdentity();
+}
 
 Object::Object(const string &model_,
                const Eigen::Vector3f &position_,
@@ -120,39 +171,68 @@ Object::Object(const string &model_,
                const string &fre_voxel_cloud_filename,
                const string &occ_voxel_cloud_filename):
   _model(model_),
+  _class_id(-1),
   _position(position_),
   _min(min_),
   _max(max_),
   _color(color_),
   _cloud(new PointCloud()),
-  _fre_voxel_cloud(new PointCloud()),
-  _occ_voxel_cloud(new PointCloud()){
+  _leaf_size(0.02f),
+  _frozen(false),
+  _last_observed(0){
     
   _ocupancy_volume = 0.0;
+  _num_occupancy_updates = 0;
+  _revision = 0;
+  _last_processed_orientation.setIdentity();
 
   pcl::io::loadPCDFile<Point> (cloud_filename, *_cloud);
 
-  _octree = new octomap::OcTree(octree_filename);
+  _octree.reset(new octomap::OcTree(octree_filename));
+  _resolution = _octree->getResolution();
 
+  PointCloud fre_voxel_cloud, occ_voxel_cloud;
   if(fre_voxel_cloud_filename != "...")
-    pcl::io::loadPCDFile<Point> (fre_voxel_cloud_filename, *_fre_voxel_cloud);
+    pcl::io::loadPCDFile<Point> (fre_voxel_cloud_filename, fre_voxel_cloud);
 
   if(occ_voxel_cloud_filename != "...")
-    pcl::io::loadPCDFile<Point> (occ_voxel_cloud_filename, *_occ_voxel_cloud);
+    pcl::io::loadPCDFile<Point> (occ_voxel_cloud_filename, occ_voxel_cloud);
+
+  _fre_voxel_cloud = quantizeVoxels(fre_voxel_cloud,_resolution);
+  _occ_voxel_cloud = quantizeVoxels(occ_voxel_cloud,_resolution);
+  _num_fre_voxels = fre_voxel_cloud.size();
+  _num_occ_voxels = occ_voxel_cloud.size();
 
+  compact();
 }
 
 Object::Object(const Object &obj):
   _model(obj.model()),
+  _class_id(obj.classId()),
   _position(obj.position()),
   _min(obj.min()),
   _max(obj.max()),
   _color(obj.color()),
   _cloud(obj.cloud()),
-  _octree(obj.octree()),
-  _fre_voxel_cloud(obj.freVoxelCloud()),
-  _occ_voxel_cloud(obj.occVoxelCloud()),
-  _ocupancy_volume(obj.ocupancy_volume()){}
+  _quantized_cloud(obj._quantized_cloud),
+  _revision(obj.revision()),
+  _ocupancy_volume(obj.ocupancy_volume()),
+  _last_processed_view(obj._last_processed_view),
+  _last_processed_orientation(obj._last_processed_orientation),
+  _num_occupancy_updates(obj.numOccupancyUpdates()),
+  _leaf_size(obj.leafSize()),
+  _resolution(obj.resolution()),
+  _grid(obj._grid),
+  _occ_voxel_cloud(obj._occ_voxel_cloud),
+  _fre_voxel_cloud(obj._fre_voxel_cloud),
+  _num_occ_voxels(obj.numOccupiedVoxels()),
+  _num_fre_voxels(obj.numFreeVoxels()),
+  _frozen(obj.frozen()),
+  _last_observed(obj.lastObserved()),
+  _payload_filename(obj.payloadFilename()){
+  std::lock_guard<std::mutex> lock(obj._export_mutex);
+  _octree = obj._octree;
+}
 
 
 Object::Object(const string &model_, 
@@ -166,20 +246,63 @@ Object::Object(const string &model_,
                const PointCloud::Ptr & occ_voxel_cloud_,
                const float ocupancy_volume_):
   _model(model_),
+  _class_id(-1),
   _position(position_),
   _min(min_),
   _max(max_),
   _color(color_),
   _cloud(cloud_),
+  _revision(0),
+  _ocupancy_volume(ocupancy_volume_),
+  _num_occupancy_updates(0),
+  _leaf_size(0.02f),
+  _resolution(octree_->getResolution()),
   _octree(octree_),
-  _fre_voxel_cloud(fre_voxel_cloud_),
-  _occ_voxel_cloud(occ_voxel_cloud_),
-  _ocupancy_volume(ocupancy_volume_){}
+  _occ_voxel_cloud(quantizeVoxels(*occ_voxel_cloud_,octree_->getResolution())),
+  _fre_voxel_cloud(quantizeVoxels(*fre_voxel_cloud_,octree_->getResolution())),
+  _num_occ_voxels(occ_voxel_cloud_->size()),
+  _num_fre_voxels(fre_voxel_cloud_->size()),
+  _frozen(false),
+  _last_observed(0){
+  _last_processed_orientation.setIdentity();
+}
 
-Object::~Object(){
-  delete _octree;
+void Object::reset(const string &model_,
+                   const Eigen::Vector3f &position_,
+                   const Eigen::Vector3f &min_,
+                   const Eigen::Vector3f &max_,
+                   const Eigen::Vector3f &color_,
+                   const PointCloud::Ptr &cloud_){
+  _model = model_;
+  _class_id = -1;
+  _position = position_;
+  _min = min_;
+  _max = max_;
+  _color = color_;
+  _cloud = cloud_;
+  _leaf_size = 0.02f;
+  _resolution = 0.05;
+  _octree.reset();
+  _grid.reset();
+
+  _quantized_cloud.reset();
+  _fre_voxel_cloud.reset();
+  _occ_voxel_cloud.reset();
+  _num_fre_voxels = 0;
+  _num_occ_voxels = 0;
+
+  _frozen = false;
+  _last_observed = 0;
+  _ocupancy_volume = 0.0;
+  _num_occupancy_updates = 0;
+  _revision = 0;
+  _last_processed_view = octomap::point3d();
+  _last_processed_orientation.setIdentity();
+  _payload_filename.clear();
 }
 
+Object::~Object(){}
+
 bool Object::operator <(const Object &o) const{
   return (_model.compare(o.model()) < 0);
 }
@@ -201,6 +324,9 @@ bool Object::inRange(const float &x, const float &y, const float &z, const float
 }
 
 void Object::merge(const ObjectPtr & o){
+  thaw();
+  _last_observed = std::max(_last_observed,o->lastObserved());
+
   if(o->min().x() < _min.x())
     _min.x() = o->min().x();
   if(o->max().x() > _max.x())
@@ -216,19 +342,257 @@ void Object::merge(const ObjectPtr & o){
 
   _position = (_min+_max)/2.0f;
   
-  //add new points
-  *_cloud += *o->cloud();
-
-  //voxelize
+  //add new points (the current cloud may be shared with a snapshot, it is not modified)
+  PointCloud::Ptr merged_cloud (new PointCloud());
+  if(_quantized_cloud)
+    _quantized_cloud->decode(*merged_cloud);
+  else
+    *merged_cloud = *_cloud;
+  *merged_cloud += *o->fullCloud();
+
+  //voxelize (the filter is local: a member would keep the merged cloud alive as its input)
   PointCloud::Ptr cloud_filtered (new PointCloud());
-  _voxelizer.setInputCloud(_cloud);
-  //  _voxelizer.setLeafSize(0.05f,0.05f,0.05f);
-  _voxelizer.setLeafSize(0.02f,0.02f,0.02f);
-  _voxelizer.filter(*cloud_filtered);
+  pcl::VoxelGrid<Point> voxelizer;
+  voxelizer.setInputCloud(merged_cloud);
+  voxelizer.setLeafSize(_leaf_size,_leaf_size,_leaf_size);
+  voxelizer.filter(*cloud_filtered);
 
   //update cloud
-  _cloud->clear();
-  *_cloud = *cloud_filtered;
+  _quantized_cloud = quantize(*cloud_filtered,CLOUD_STEP);
+  if(!_cloud->empty())
+    _cloud.reset(new PointCloud());
+  _revision++;
+}
+
+void Object::setResolution(float octree_resolution, float leaf_size){
+  _leaf_size = leaf_size;
+  if(_resolution == octree_resolution)
+    return;
+  _resolution = octree_resolution;
+  if(_grid)
+    _grid.reset(new OccupancyGrid(octree_resolution));
+  _octree.reset();
+}
+
+void Object::useDenseGrid(){
+  if(_grid)
+    return;
+  _grid.reset(new OccupancyGrid(resolution()));
+  _octree.reset();
+}
+
+octomap::OcTree* Object::octree() const{
+  std::lock_guard<std::mutex> lock(_export_mutex);
+  if(!_octree)
+    _octree.reset(_grid ? _grid->exportOcTree() : new octomap::OcTree(_resolution));
+  return _octree.get();
+}
+
+void Object::setCloud(const PointCloud::Ptr &cloud){
+  _cloud = cloud;
+  _quantized_cloud.reset();
+  _revision++;
+}
+
+PointCloud::Ptr Object::fullCloud() const{
+  return _quantized_cloud ? decode(_quantized_cloud) : _cloud;
+}
+
+void Object::copyCloud(Point *points) const{
+  if(_quantized_cloud){
+    _quantized_cloud->decode(points);
+    return;
+  }
+  std::copy(_cloud->points.begin(),_cloud->points.end(),points);
+}
+
+PointCloud::Ptr Object::freVoxelCloud() const{
+  return decode(_fre_voxel_cloud);
+}
+
+PointCloud::Ptr Object::occVoxelCloud() const{
+  return decode(_occ_voxel_cloud);
+}
+
+void Object::compact(){
+  if(_quantized_cloud)
+    return;
+
+  //the raw cloud may still be held by a pending occupancy update, it is released, not cleared
+  _quantized_cloud = quantize(*_cloud,CLOUD_STEP);
+  _cloud.reset(new PointCloud());
+}
+
+void Object::freeze(){
+  if(_frozen || !resident())
+    return;
+
+  //the octree (exported from the dense grid if any) is reduced to free/occupied voxels and pruned,
+  //it is copied if a snapshot still holds it
+  {
+    std::lock_guard<std::mutex> lock(_export_mutex);
+    if(_grid){
+      if(!_octree)
+        _octree.reset(_grid->exportOcTree());
+      _grid.reset();
+    }
+    if(_octree && _octree.use_count() > 1)
+      _octree.reset(new octomap::OcTree(*_octree));
+    if(_octree){
+      _octree->toMaxLikelihood();
+      _octree->prune();
+    }
+  }
+
+  compact();
+
+  //rebuilt by the next occupancy update
+  _fre_voxel_cloud.reset();
+  _occ_voxel_cloud.reset();
+
+  _frozen = true;
+}
+
+void Object::thaw(){
+  _frozen = false;
+}
+
+ObjectMemory &ObjectMemory::operator += (const ObjectMemory &m){
+  cloud += m.cloud;
+  occupancy += m.occupancy;
+  voxel_clouds += m.voxel_clouds;
+  return *this;
+}
+
+namespace {
+
+  inline size_t cloudBytes(const PointCloud::ConstPtr &cloud){
+    return cloud ? sizeof(PointCloud)+cloud->points.capacity()*sizeof(Point) : 0;
+  }
+
+  inline size_t cloudBytes(const std::shared_ptr<const QuantizedCloud> &cloud){
+    return cloud ? cloud->memoryUsage() : 0;
+  }
+
+}
+
+ObjectMemory Object::memoryUsage() const{
+  ObjectMemory memory;
+  memory.cloud = cloudBytes(_cloud)+cloudBytes(_quantized_cloud);
+  memory.voxel_clouds = cloudBytes(_fre_voxel_cloud)+cloudBytes(_occ_voxel_cloud);
+
+  std::lock_guard<std::mutex> lock(_export_mutex);
+  if(_grid)
+    memory.occupancy += _grid->memoryUsage();
+  if(_octree)
+    memory.occupancy += _octree->memoryUsage();
+  return memory;
+}
+
+bool Object::occupancy(const octomap::point3d &point, float &probability) const{
+  if(_grid)
+    return _grid->search(point,probability);
+
+  std::shared_ptr<octomap::OcTree> tree;
+  {
+    std::lock_guard<std::mutex> lock(_export_mutex);
+    tree = _octree;
+  }
+  const octomap::OcTreeNode *voxel = tree ? tree->search(point) : 0;
+  if(!voxel)
+    return false;
+  probability = voxel->getOccupancy();
+  return true;
+}
+
+namespace {
+
+  //octree leaves are updated lazily, inner nodes are refreshed once after the whole view is integrated
+  inline void insertScan(octomap::OcTree &tree, const octomap::Pointcloud &scan, const octomap::point3d &sensor_origin){
+    tree.insertPointCloud(scan,sensor_origin,-1.0,true);
+  }
+
+  inline void insertScan(OccupancyGrid &grid, const octomap::Pointcloud &scan, const octomap::point3d &sensor_origin){
+    grid.insertPointCloud(scan,sensor_origin);
+  }
+
+  //scan, background wall and voxel centers of the occupancy updates, reused by the updates run on the same thread
+  struct ScanBuffers{
+    octomap::Pointcloud scan;
+    octomap::Pointcloud background_wall;
+    PointCloud occupied_voxels;
+    PointCloud free_voxels;
+  };
+  thread_local ScanBuffers scan_buffers;
+
+  //integrate a view in tree (octomap::OcTree or OccupancyGrid): the scan, then a background wall
+  //behind the object in the directions it does not occlude
+  template <class Tree>
+  void integrateView(Tree &tree,
+                     const octomap::Pointcloud &scan,
+                     const octomap::point3d &sensor_origin,
+                     float cameraYawAngle,
+                     float distance,
+                     octomap::Pointcloud &background_wall){
+
+    insertScan(tree,scan,sensor_origin);
+
+    //the sensor FoV in global coordinates: each wall point is rotated when it is visited
+    //(as octomap::Pointcloud::transform does) instead of building the 76800 points
+    octomap::point3d wall_point(1,0,0);
+
+    octomath::Vector3 translation(0,0,0);
+    octomath::Quaternion rotation(0,0,-cameraYawAngle);
+    octomap::pose6d isometry(translation,rotation);
+
+    //>>>>>>>>>> Create background wall to identify known empty volxels <<<<<<<<<<
+
+    /*	A background wall is built leaving empty the shadow of the object, this is
+        necesary so that the octree can recognize what area is empty known and
+        unknown, otherwise it will assume all tree.writeBinary("check.bt");surroundings of the cloud as unknown.  */
+
+    float alpha;	//	Angle in xy plane from sensorOrigin to each point in Pointwall
+    float beta;		//	Elevation angle from sensorOrigin to each point in Pointwall
+    float xp, yp, zp;		//	x,y,z coordinates of each point in Pointwall expressed in sensorOrigin coordinates
+    float leg_adjacent_point_wall;		//	Leg adjacent length of a right triangle formed from sensorOrigin to each point in Pointwall
+    float leg_adjacent_background_point;		//	Leg adjacent length of a right triangle formed from sensorOrigin to the new background point
+    octomap::point3d iterator; //  Helper needed for castRay function
+    background_wall.clear();
+
+    for(int y=1;y<321;y++){
+      for(int z=1;z<241;z++){
+        wall_point.y()= (-0.560027)+(y*0.003489);
+        wall_point.z()= (-0.430668)+(z*0.003574);
+        const octomap::point3d direction = isometry.transform(wall_point);
+
+        if(!tree.castRay(sensor_origin,direction,iterator,false,distance)){
+
+          //	Transform pointwall point to sensorOrigin coordinates subtracting sensorOrigin
+          xp=direction.x();
+          yp=direction.y();
+          zp=direction.z();
+
+          //	Get alpha and beta angles
+          alpha=atan2(yp,xp);
+          leg_adjacent_point_wall=sqrt((xp*xp)+(yp*yp));
+          beta=atan2(zp,leg_adjacent_point_wall);
+
+          //	Get the new background points and return to global coordinates by adding sensorOrigin
+          iterator.z()=sensor_origin.z()+distance*sin(beta);
+          leg_adjacent_background_point=sqrt((distance*distance)-(zp*zp));
+          iterator.y()=sensor_origin.y()+leg_adjacent_background_point*sin(alpha);
+          iterator.x()=sensor_origin.x()+leg_adjacent_background_point*cos(alpha);
+
+          background_wall.push_back(iterator);		//	add points to point cloud
+        }
+      }
+    }
+
+    // std::cout << " Raytrace completed! " <<std::endl;
+
+    insertScan(tree,background_wall,sensor_origin);
+  }
+
 }
 
 void Object::updateOccupancy(const Eigen::Isometry3f &T, const PointCloud::Ptr & cloud){
@@ -236,7 +600,11 @@ void Object::updateOccupancy(const Eigen::Isometry3f &T, const PointCloud::Ptr &
   if(cloud->empty())
     return;
 
-  octomap::Pointcloud scan;
+  thaw();
+
+  octomap::Pointcloud &scan = scan_buffers.scan;
+  scan.clear();
+  scan.reserve(cloud->size());
   for(const Point& pt : cloud->points)
     scan.push_back(pt.x,pt.y,pt.z);
 
@@ -249,46 +617,11 @@ void Object::updateOccupancy(const Eigen::Isometry3f &T, const PointCloud::Ptr &
   //x.fromRotationMatrix(T.linear());
   //std::cout << "AngleZ... " << x.axis() << std::endl;
   //rotationAngles.fromRotationMatrix(T.linear());
-  _octree->insertPointCloud(scan,sensor_origin);
-  
-
-  
-  octomap::Pointcloud wall_point_cloud; //  wall_point_cloud will represent the sensor FoV in global coordinates.
-  octomap::point3d wall_point(1,0,0);    //  each point3d to be inserted into Pointwall
-
-  for(int y=1;y<321;y++){
-    for(int z=1;z<241;z++){
-      wall_point.y()= (-0.560027)+(y*0.003489);
-      wall_point.z()= (-0.430668)+(z*0.003574);
-      wall_point_cloud.push_back(wall_point);
-    }
-  }
-
-  octomath::Vector3 translation(0,0,0);
-  float roll=atan2(_position.y()-sensor_origin.y(),_position.x()-sensor_origin.x());
-  //std::cout << " yawn: " << roll << std::endl;
-  octomath::Quaternion rotation(0,0,-cameraYawAngle);
-  octomap::pose6d isometry(translation,rotation);
-  wall_point_cloud.transform(isometry);
-
-  //>>>>>>>>>> Create background wall to identify known empty volxels <<<<<<<<<<
-
-  /*	A background wall is built leaving empty the shadow of the object, this is
-      necesary so that the octree can recognize what area is empty known and
-      unknown, otherwise it will assume all tree.writeBinary("check.bt");surroundings of the cloud as unknown.  */
-  
-  float alpha;	//	Angle in xy plane from sensorOrigin to each point in Pointwall
-  float beta;		//	Elevation angle from sensorOrigin to each point in Pointwall
-  float xp, yp, zp;		//	x,y,z coordinates of each point in Pointwall expressed in sensorOrigin coordinates
-  float leg_adjacent_point_wall;		//	Leg adjacent length of a right triangle formed from sensorOrigin to each point in Pointwall
-  float leg_adjacent_background_point;		//	Leg adjacent length of a right triangle formed from sensorOrigin to the new background point
-  float distance;		//  Distance from the sensorOrigin and the new background point
-  octomap::Pointcloud background_wall;     //  Pointcloud holding the background wall
-  octomap::point3d iterator; //  Helper needed for castRay function
 
   //  distance will be computed so that the wall is always behind the object
   //  distance = 2D_Distance-Centroid-FarthermostPointInBBox + offset + 2D_Distance-sensorOrigin-Centroid
   float OFFSET=0.1;
+  float distance;
   Eigen::Vector3f squared_distances;
   squared_distances[0]=pow(_position.x()-(_max.x()+OFFSET),2);
   squared_distances[1]=pow(_position.y()-(_max.y()+OFFSET),2);
@@ -297,75 +630,304 @@ void Object::updateOccupancy(const Eigen::Isometry3f &T, const PointCloud::Ptr &
   squared_distances[1]=pow(_position.y()-sensor_origin.y(),2);
 
   distance+=sqrt(squared_distances[0]+squared_distances[1]);
-  
-  for(int i=0;i<wall_point_cloud.size();i++){
-      //std::cout << ".";
 
-    if(!_octree->castRay(sensor_origin,wall_point_cloud.getPoint(i),iterator,false,distance)){
+  //voxels farther than OFFSET from the box are dropped
+  OFFSET+=-0.01;
+  const Eigen::Vector3f range_min = _min-Eigen::Vector3f::Constant(OFFSET);
+  const Eigen::Vector3f range_max = _max+Eigen::Vector3f::Constant(OFFSET);
+
+  //objects too big for a dense grid fall back to the octree
+  if(_grid && _grid->numCells(range_min,range_max) > OccupancyGrid::MAX_CELLS){
+    std::lock_guard<std::mutex> lock(_export_mutex);
+    _octree.reset(_grid->exportOcTree());
+    _grid.reset();
+  }
 
-      //	Transform pointwall point to sensorOrigin coordinates subtracting sensorOrigin
-      xp=wall_point_cloud.getPoint(i).x();
-      yp=wall_point_cloud.getPoint(i).y();
-      zp=wall_point_cloud.getPoint(i).z();
+  Point pt;
+  PointCloud &occ_voxel_cloud = scan_buffers.occupied_voxels;
+  PointCloud &fre_voxel_cloud = scan_buffers.free_voxels;
+  occ_voxel_cloud.clear();
+  fre_voxel_cloud.clear();
+  _ocupancy_volume=0.0;
+
+  if(_grid){
+    //copy the grid if a snapshot still holds it, the exported octree is stale
+    if(_grid.use_count() > 1)
+      _grid.reset(new OccupancyGrid(*_grid));
+    {
+      std::lock_guard<std::mutex> lock(_export_mutex);
+      _octree.reset();
+    }
 
-      //	Get alpha and beta angles
-      alpha=atan2(yp,xp);
-      leg_adjacent_point_wall=sqrt((xp*xp)+(yp*yp));
-      beta=atan2(zp,leg_adjacent_point_wall);
+    //the grid covers exactly the voxels kept by the octree path
+    _grid->setBounds(range_min,range_max);
+    integrateView(*_grid,scan,sensor_origin,cameraYawAngle,distance,scan_buffers.background_wall);
 
-      //	Get the new background points and return to global coordinates by adding sensorOrigin
-      iterator.z()=sensor_origin.z()+distance*sin(beta);
-      leg_adjacent_background_point=sqrt((distance*distance)-(zp*zp));
-      iterator.y()=sensor_origin.y()+leg_adjacent_background_point*sin(alpha);
-      iterator.x()=sensor_origin.x()+leg_adjacent_background_point*cos(alpha);
+    const float voxel_volume = pow(_grid->resolution(),3);
+    for(size_t i=0; i<_grid->size(); ++i){
+      if(!_grid->known(i))
+        continue;
+      const octomap::point3d p = _grid->cellCenter(i);
+      pt.x = p.x();
+      pt.y = p.y();
+      pt.z = p.z();
+      if(_grid->occupancy(i)>0.49){ // occupied voxels
+        occ_voxel_cloud.points.push_back(pt);
+        _ocupancy_volume+=voxel_volume;
+      } else { // free voxels
+        fre_voxel_cloud.points.push_back(pt);
+      }
+    }
+  } else {
+    //allocate the octree on the first update, copy it if a snapshot still holds it
+    {
+      std::lock_guard<std::mutex> lock(_export_mutex);
+      if(!_octree)
+        _octree.reset(new octomap::OcTree(_resolution));
+      else if(_octree.use_count() > 1)
+        _octree.reset(new octomap::OcTree(*_octree));
+    }
+
+    //castRay only reads leaves, the inner nodes of both insertions are refreshed (and pruned) here
+    integrateView(*_octree,scan,sensor_origin,cameraYawAngle,distance,scan_buffers.background_wall);
+    _octree->updateInnerOccupancy();
+    _octree->prune();
+
+    octomap::point3d p;
+    for(octomap::OcTree::leaf_iterator it = _octree->begin_leafs(),end=_octree->end_leafs(); it!= end; ++it) {
+
+      p = it.getCoordinate();
+      octomap::OcTreeNode * iteratorNode=_octree->search(it.getKey());
+      if(!inRange(p.x(),p.y(),p.z(),OFFSET)){
+        _octree->deleteNode(it.getKey());
+      }else if (iteratorNode->getOccupancy()>0.49){ // occupied voxels
+        pt.x = p.x();
+        pt.y = p.y();
+        pt.z = p.z();
+        occ_voxel_cloud.points.push_back(pt);
+        _ocupancy_volume+=pow(it.getSize(),3);
+      }
+      else { // free voxels
+        pt.x = p.x();
+        pt.y = p.y();
+        pt.z = p.z();
+        fre_voxel_cloud.points.push_back(pt);
+      }
 
-      background_wall.push_back(iterator);		//	add points to point cloud
     }
   }
 
- 
-  // std::cout << " Raytrace completed! " <<std::endl;
+  _last_processed_view = sensor_origin;
+  _last_processed_orientation = Eigen::Quaternionf(T.linear());
+  _num_occupancy_updates++;
 
-  _octree->insertPointCloud(background_wall,sensor_origin);    
-   
-  octomap::point3d p;
-  Point pt;
-  _occ_voxel_cloud->clear();
-  _fre_voxel_cloud->clear();
-  _ocupancy_volume=0.0; 
-  
-  OFFSET+=-0.01;
+  _fre_voxel_cloud = quantizeVoxels(fre_voxel_cloud,_resolution);
+  _occ_voxel_cloud = quantizeVoxels(occ_voxel_cloud,_resolution);
 
+  _num_fre_voxels = fre_voxel_cloud.size();
+  _num_occ_voxels = occ_voxel_cloud.size();
+}
 
+void Object::viewChange(const Eigen::Isometry3f &T, float &distance, float &angle) const{
+  distance = (T.translation()-lastProcessedView()).norm();
+  angle = _last_processed_orientation.angularDistance(Eigen::Quaternionf(T.linear()));
+}
 
-  for(octomap::OcTree::leaf_iterator it = _octree->begin_leafs(),end=_octree->end_leafs(); it!= end; ++it) {  
+namespace {
 
-    p = it.getCoordinate();
-    octomap::OcTreeNode * iteratorNode=_octree->search(it.getKey());
-    if(!inRange(p.x(),p.y(),p.z(),OFFSET)){
-      _octree->deleteNode(it.getKey());
-    }else if (iteratorNode->getOccupancy()>0.49){ // occupied voxels 
-      pt.x = p.x();
-      pt.y = p.y();
-      pt.z = p.z();
-      _occ_voxel_cloud->points.push_back(pt);
-      _ocupancy_volume+=pow(it.getSize(),3);
-    }
-    else { // free voxels
-      pt.x = p.x();
-      pt.y = p.y();
-      pt.z = p.z();
-      _fre_voxel_cloud->points.push_back(pt);
+  template <typename T>
+  void appendBinary(std::string &buffer, const T &value){
+    buffer.append(reinterpret_cast<const char*>(&value),sizeof(T));
+  }
+
+  void appendBinary(std::string &buffer, const Eigen::Vector3f &v){
+    appendBinary(buffer,v.x());
+    appendBinary(buffer,v.y());
+    appendBinary(buffer,v.z());
+  }
+
+  void appendBinary(std::string &buffer, const PointCloud &cloud){
+    appendBinary(buffer,static_cast<uint64_t>(cloud.size()));
+    buffer.append(reinterpret_cast<const char*>(cloud.points.data()),cloud.size()*sizeof(Point));
+  }
+
+  template <typename T>
+  bool readBinaryValue(const char* &data, const char *end, T &value){
+    if(end-data < (ptrdiff_t)sizeof(T))
+      return false;
+    memcpy(&value,data,sizeof(T));
+    data += sizeof(T);
+    return true;
+  }
+
+  bool readBinaryValue(const char* &data, const char *end, Eigen::Vector3f &v){
+    return readBinaryValue(data,end,v.x()) && readBinaryValue(data,end,v.y()) && readBinaryValue(data,end,v.z());
+  }
+
+  bool readBinaryValue(const char* &data, const char *end, PointCloud &cloud){
+    uint64_t size;
+    if(!readBinaryValue(data,end,size) || (uint64_t)(end-data) < size*sizeof(Point))
+      return false;
+    cloud.points.resize(size);
+    memcpy(cloud.points.data(),data,size*sizeof(Point));
+    cloud.width = size;
+    cloud.height = 1;
+    data += size*sizeof(Point);
+    return true;
+  }
+
+  //read-only stream over a memory region (e.g. a memory-mapped file)
+  struct MemoryBuffer : public std::streambuf{
+    MemoryBuffer(const char *data, size_t size){
+      char *p = const_cast<char*>(data);
+      setg(p,p,p+size);
     }
-    
+  };
+
+}
+
+void Object::writeBinary(std::string &buffer) const{
+  //the record of an evicted object is the content of its payload file
+  if(!resident()){
+    std::ifstream file(_payload_filename.c_str(),std::ios::binary);
+    buffer.append(std::istreambuf_iterator<char>(file),std::istreambuf_iterator<char>());
+    return;
+  }
+
+  appendBinary(buffer,static_cast<uint32_t>(_model.size()));
+  buffer.append(_model);
+  appendBinary(buffer,_position);
+  appendBinary(buffer,_min);
+  appendBinary(buffer,_max);
+  appendBinary(buffer,_color);
+  appendBinary(buffer,_ocupancy_volume);
+  appendBinary(buffer,_revision);
+  appendBinary(buffer,_num_occupancy_updates);
+  appendBinary(buffer,Eigen::Vector3f(lastProcessedView()));
+  appendBinary(buffer,_last_processed_orientation.coeffs().x());
+  appendBinary(buffer,_last_processed_orientation.coeffs().y());
+  appendBinary(buffer,_last_processed_orientation.coeffs().z());
+  appendBinary(buffer,_last_processed_orientation.coeffs().w());
+  appendBinary(buffer,*fullCloud());
+  appendBinary(buffer,*freVoxelCloud());
+  appendBinary(buffer,*occVoxelCloud());
+  appendBinary(buffer,_leaf_size);
+  appendBinary(buffer,static_cast<uint64_t>(_num_fre_voxels));
+  appendBinary(buffer,static_cast<uint64_t>(_num_occ_voxels));
+
+  //dense grid, or full octree (with occupancy probabilities) prefixed by resolution and size
+  appendBinary(buffer,static_cast<uint8_t>(_grid ? 1 : 0));
+  if(_grid){
+    _grid->write(buffer);
+    return;
   }
+  const octomap::OcTree *tree = octree();
+  std::ostringstream octree_stream;
+  tree->writeData(octree_stream);
+  const std::string octree_data = octree_stream.str();
+  appendBinary(buffer,tree->getResolution());
+  appendBinary(buffer,static_cast<uint64_t>(octree_data.size()));
+  buffer.append(octree_data);
+}
 
-  _last_processed_view.x()=sensor_origin.x();
-  _last_processed_view.y()=sensor_origin.y();
+bool Object::readBinary(const char* &data, const char *end){
+  uint32_t model_size;
+  if(!readBinaryValue(data,end,model_size) || (uint32_t)(end-data) < model_size)
+    return false;
+  _model.assign(data,model_size);
+  data += model_size;
+
+  //fresh payload, the previous one may be shared with a snapshot
+  _cloud.reset(new PointCloud());
+  _quantized_cloud.reset();
+  PointCloud fre_voxel_cloud, occ_voxel_cloud;
+
+  //a frozen object is read back thawed
+  _frozen = false;
+
+  Eigen::Vector3f last_view;
+  float qx,qy,qz,qw;
+  uint64_t num_fre_voxels,num_occ_voxels;
+  if(!readBinaryValue(data,end,_position) ||
+     !readBinaryValue(data,end,_min) ||
+     !readBinaryValue(data,end,_max) ||
+     !readBinaryValue(data,end,_color) ||
+     !readBinaryValue(data,end,_ocupancy_volume) ||
+     !readBinaryValue(data,end,_revision) ||
+     !readBinaryValue(data,end,_num_occupancy_updates) ||
+     !readBinaryValue(data,end,last_view) ||
+     !readBinaryValue(data,end,qx) ||
+     !readBinaryValue(data,end,qy) ||
+     !readBinaryValue(data,end,qz) ||
+     !readBinaryValue(data,end,qw) ||
+     !readBinaryValue(data,end,*_cloud) ||
+     !readBinaryValue(data,end,fre_voxel_cloud) ||
+     !readBinaryValue(data,end,occ_voxel_cloud) ||
+     !readBinaryValue(data,end,_leaf_size) ||
+     !readBinaryValue(data,end,num_fre_voxels) ||
+     !readBinaryValue(data,end,num_occ_voxels))
+    return false;
+  _num_fre_voxels = num_fre_voxels;
+  _num_occ_voxels = num_occ_voxels;
+  _last_processed_view = octomap::point3d(last_view.x(),last_view.y(),last_view.z());
+  _last_processed_orientation = Eigen::Quaternionf(qw,qx,qy,qz);
+
+  uint8_t dense;
+  if(!readBinaryValue(data,end,dense))
+    return false;
+  if(dense){
+    _grid.reset(new OccupancyGrid());
+    _octree.reset();
+    if(!_grid->read(data,end))
+      return false;
+    _resolution = _grid->resolution();
+  } else {
+    _grid.reset();
+
+    double resolution;
+    uint64_t octree_size;
+    if(!readBinaryValue(data,end,resolution) ||
+       !readBinaryValue(data,end,octree_size) ||
+       (uint64_t)(end-data) < octree_size)
+      return false;
+
+    MemoryBuffer octree_buffer(data,octree_size);
+    std::istream octree_stream(&octree_buffer);
+    _resolution = resolution;
+    _octree.reset(new octomap::OcTree(resolution));
+    _octree->readData(octree_stream);
+    data += octree_size;
+  }
 
-  _fre_voxel_cloud->width = _fre_voxel_cloud->size();
-  _fre_voxel_cloud->height = 1;
+  //records hold pcl clouds, they are kept quantized
+  compact();
+  _fre_voxel_cloud = quantizeVoxels(fre_voxel_cloud,_resolution);
+  _occ_voxel_cloud = quantizeVoxels(occ_voxel_cloud,_resolution);
+
+  return true;
+}
+
+void Object::evict(const std::string &filename){
+  if(_grid)
+    _grid.reset(new OccupancyGrid(_grid->resolution()));
+  _octree.reset();
+  _cloud.reset(new PointCloud());
+  _quantized_cloud.reset();
+  _fre_voxel_cloud.reset();
+  _occ_voxel_cloud.reset();
+  _frozen = false;
+  _payload_filename = filename;
+}
+
+bool Object::attach(const std::string &record){
+  const char *data = record.data();
+  if(!readBinary(data,data+record.size()))
+    return false;
+  _payload_filename.clear();
+  return true;
+}
 
-  _occ_voxel_cloud->width = _occ_voxel_cloud->size();
-  _occ_voxel_cloud->height = 1;
+void Object::discardPayload(){
+  _payload_filename.clear();
+  _revision++;
 }
@@ -3,6 +3,8 @@
 #include <iostream>
 #include <string>
 #include <vector>
+#include <mutex>
+#include <memory>
 
 #include <Eigen/Core>
 #include <Eigen/Geometry>
@@ -18,6 +20,9 @@
 
 #include <yaml-cpp/yaml.h>
 
+#include "occupancy_grid.h"
+#include "quantized_cloud.h"
+
 typedef pcl::PointXYZRGB Point;
 typedef pcl::PointCloud<Point> PointCloud;
 
@@ -32,8 +37,27 @@ typedef std::map<std::string,ObjectPtr> StringObjectPtrMap;
 class GtObject;
 typedef std::map<std::string,GtObject> GtObjectStringMap;
 
+//bytes used by an object (see Object::memoryUsage)
+struct ObjectMemory{
+  ObjectMemory():cloud(0),occupancy(0),voxel_clouds(0){}
+  //raw (local objects) or quantized cloud
+  size_t cloud;
+  //octree, or dense grid plus its exported octree
+  size_t occupancy;
+  //free and occupied voxel clouds
+  size_t voxel_clouds;
+  inline size_t total() const {return cloud+occupancy+voxel_clouds;}
+  ObjectMemory &operator += (const ObjectMemory &m);
+};
+
 
-//this class is a container for a 3d object that composes the semantic map
+//this class is a container for a 3d object that composes the semantic map.
+//Clouds and octree are copy-on-write: updates replace them instead of modifying them in place,
+//so copies of an object (e.g. in a map snapshot) stay valid while the object keeps changing.
+//The cloud of an object in the global map and its voxel clouds are stored quantized (see QuantizedCloud),
+//pcl clouds are decoded only to export them. Objects extracted from a frame keep their raw cloud.
+//A stale object can be frozen: its octree is made max-likelihood and pruned and its voxel clouds are
+//dropped (their sizes are kept). Merges and occupancy updates thaw it first
 class Object {
   public:
     EIGEN_MAKE_ALIGNED_OPERATOR_NEW
@@ -71,6 +95,14 @@ class Object {
 
     Object(const Object& obj);
 
+    //reinitialize a recycled object as the constructor does (see SemanticMapper::extractObjects)
+    void reset(const std::string &model_,
+               const Eigen::Vector3f &position_,
+               const Eigen::Vector3f &min_,
+               const Eigen::Vector3f &max_,
+               const Eigen::Vector3f &color_,
+               const PointCloud::Ptr &cloud_);
+
     //dtor
     ~Object();
 
@@ -80,6 +112,8 @@ class Object {
     //setters and getters
     inline const std::string& model() const {return _model;}
     inline std::string& model() {return _model;}
+    inline const int classId() const {return _class_id;}
+    inline int &classId() {return _class_id;}
     inline const Eigen::Vector3f& position() const {return _position;}
     inline Eigen::Vector3f& position() {return _position;}
     inline const Eigen::Vector3f& min() const {return _min;}
@@ -88,15 +122,72 @@ class Object {
     inline Eigen::Vector3f& max() {return _max;}
     inline const Eigen::Vector3f &color() const {return _color;}
     inline Eigen::Vector3f &color() {return _color;}
+    //raw cloud of an object extracted from a frame, empty once compacted (see fullCloud)
     inline const PointCloud::Ptr &cloud() const {return _cloud;}
     inline PointCloud::Ptr &cloud() {return _cloud;}
+    void setCloud(const PointCloud::Ptr &cloud);
     inline const float ocupancy_volume() const {return _ocupancy_volume;}
     inline float ocupancy_volume() {return _ocupancy_volume;}    
 
-    inline const PointCloud::Ptr &freVoxelCloud() const {return _fre_voxel_cloud;}
-    inline const PointCloud::Ptr &occVoxelCloud() const {return _occ_voxel_cloud;}
+    //centers of the free and occupied voxels of the last occupancy update, decoded (empty if frozen)
+    PointCloud::Ptr freVoxelCloud() const;
+    PointCloud::Ptr occVoxelCloud() const;
+
+    //the raw cloud, or the decoded quantized cloud of a compacted object
+    PointCloud::Ptr fullCloud() const;
+    inline size_t numPoints() const {return _quantized_cloud ? _quantized_cloud->size() : _cloud->size();}
+
+    //write the numPoints() points of the cloud to points
+    void copyCloud(Point *points) const;
+
+    //replace the raw cloud by its quantized copy (objects added to the global map)
+    void compact();
+    inline bool compacted() const {return _quantized_cloud != nullptr;}
+
+    //sizes of the voxel clouds of the last occupancy update (also for frozen objects)
+    inline size_t numFreeVoxels() const {return _num_fre_voxels;}
+    inline size_t numOccupiedVoxels() const {return _num_occ_voxels;}
+
+    //compact a stale object / mark it as updated again (the octree stays max-likelihood)
+    void freeze();
+    void thaw();
+    inline bool frozen() const {return _frozen;}
+
+    //mapper frame (see GlobalMap::nextFrame) in which the object was last observed
+    inline uint64_t lastObserved() const {return _last_observed;}
+    inline void setLastObserved(uint64_t frame) {_last_observed = frame;}
+
+    //occupancy octree, exported from the dense grid (on the first call after an update) if the object uses one.
+    //The octree is allocated on the first update, before that an empty one is created on demand
+    octomap::OcTree* octree() const;
+
+    //dense occupancy grid (null if the object uses the octree)
+    inline const OccupancyGrid *grid() const {return _grid.get();}
+
+    //use a dense grid instead of the octree, call it before the first occupancy update
+    void useDenseGrid();
+
+    inline double resolution() const {return _resolution;}
+
+    //occupancy probability of the voxel at point, false if unknown
+    bool occupancy(const octomap::point3d &point, float &probability) const;
 
-    inline octomap::OcTree* octree() const {return _octree;}
+    //bytes used by the object (payloads shared with snapshot copies are counted by each of them)
+    ObjectMemory memoryUsage() const;
+
+    //octree resolution and voxel leaf of the merged cloud (see ResolutionPolicy),
+    //the octree is replaced by an empty one: set them before the first occupancy update
+    void setResolution(float octree_resolution, float leaf_size);
+    inline float leafSize() const {return _leaf_size;}
+
+    inline Eigen::Vector3f lastProcessedView() const {return Eigen::Vector3f(_last_processed_view.x(),_last_processed_view.y(),_last_processed_view.z());}
+    inline const int numOccupancyUpdates() const {return _num_occupancy_updates;}
+
+    //incremented every time the object cloud changes
+    inline const int revision() const {return _revision;}
+
+    //serializes the updates of an object of a map shared by several cameras (merge, occupancy)
+    inline std::mutex &mutex() const {return _mutex;}
 
     //check if a point falls in the bounding box
     bool inRange(const Point &point) const;
@@ -104,17 +195,42 @@ class Object {
     //check if a point falls in the bounding box
     bool inRange(const float& x, const float& y, const float& z, const float& off) const;
 
-    //merge two objects
+    //merge two objects (a frozen object is thawed), the merged cloud is compacted
     void merge(const ObjectPtr &o);
 
-    //compute occupancy
+    //compute occupancy (a frozen object is thawed)
     void updateOccupancy(const Eigen::Isometry3f& T, const PointCloud::Ptr &cloud);
 
+    //translation and rotation angle between the sensor pose T and the last processed view
+    void viewChange(const Eigen::Isometry3f& T, float &distance, float &angle) const;
+
+    //append a binary record of the object (boxes, clouds, full octree) to buffer
+    void writeBinary(std::string &buffer) const;
+
+    //read a record written by writeBinary starting at data, data is moved past the record
+    bool readBinary(const char* &data, const char *end);
+
+    //an evicted object keeps only its boxes, its payload (clouds and octree) is stored in a file
+    inline bool resident() const {return _payload_filename.empty();}
+    inline const std::string &payloadFilename() const {return _payload_filename;}
+
+    //release the payload, whose record (see writeBinary) is stored in filename
+    void evict(const std::string &filename);
+
+    //restore the payload of an evicted object from its record
+    bool attach(const std::string &record);
+
+    //give up the unreadable payload of an evicted object, which becomes resident with its box only
+    void discardPayload();
+
   private:
 
     //name
     std::string _model;
 
+    //dense id of the semantic class (see ClassRegistry)
+    int _class_id;
+
     //position
     Eigen::Vector3f _position;
 
@@ -127,20 +243,44 @@ class Object {
     //object color (for visualization only)
     Eigen::Vector3f _color;
 
-    //object point cloud
+    //object point cloud: raw, or quantized once compacted
     PointCloud::Ptr _cloud;
+    std::shared_ptr<const QuantizedCloud> _quantized_cloud;
+
+    //geometry revision
+    int _revision;
 
     //ocupancy volume
     float _ocupancy_volume;
 
     //last processed view
     octomap::point3d _last_processed_view;
-    
-    pcl::VoxelGrid<Point> _voxelizer;
+    Eigen::Quaternionf _last_processed_orientation;
+
+    //number of views integrated in the octree
+    int _num_occupancy_updates;
+
+    //voxel leaf of the merged cloud
+    float _leaf_size;
+
+    //occupancy: either the octree, or the dense grid and its lazily exported octree
+    double _resolution;
+    mutable std::shared_ptr<octomap::OcTree> _octree;
+    std::shared_ptr<OccupancyGrid> _grid;
+    mutable std::mutex _export_mutex;
+    std::shared_ptr<const QuantizedCloud> _occ_voxel_cloud;
+    std::shared_ptr<const QuantizedCloud> _fre_voxel_cloud;
+    size_t _num_occ_voxels;
+    size_t _num_fre_voxels;
+
+    //frozen tier
+    bool _frozen;
+    uint64_t _last_observed;
+
+    //file that holds the payload of an evicted object (empty if resident)
+    std::string _payload_filename;
 
-    octomap::OcTree* _octree;
-    PointCloud::Ptr _occ_voxel_cloud;
-    PointCloud::Ptr _fre_voxel_cloud;
+    mutable std::mutex _mutex;
 };
 
 class GtObject{
@@ -0,0 +1,326 @@
+#include "occupancy_grid.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+namespace {
+
+  //sensor model of octomap::OcTree (default parameters)
+  const float LOG_ODDS_HIT = 0.847298f;    //logodds(0.7)
+  const float LOG_ODDS_MISS = -0.405465f;  //logodds(0.4)
+  const float CLAMPING_MIN = -2.0f;        //logodds(0.1192)
+  const float CLAMPING_MAX = 3.511031f;    //logodds(0.971)
+  const float OCCUPANCY_THRESHOLD = 0.0f;  //logodds(0.5)
+
+  const uint8_t MISS = 1;
+  const uint8_t HIT = 2;
+
+  template <typename T>
+  void appendBinary(std::string &buffer, const T &value){
+    buffer.append(reinterpret_cast<const char*>(&value),sizeof(T));
+  }
+
+  template <typename T>
+  bool readBinaryValue(const char* &data, const char *end, T &value){
+    if(end-data < (ptrdiff_t)sizeof(T))
+      return false;
+    memcpy(&value,data,sizeof(T));
+    data += sizeof(T);
+    return true;
+  }
+
+}
+
+OccupancyGrid::OccupancyGrid(double resolution):
+  _resolution(resolution),
+  _first(Eigen::Vector3i::Zero()),
+  _size(Eigen::Vector3i::Zero()){}
+
+void OccupancyGrid::bounds(const Eigen::Vector3f &min, const Eigen::Vector3f &max, Eigen::Vector3i &first, Eigen::Vector3i &size) const{
+  for(int a=0; a<3; ++a){
+    first[a] = std::ceil(min[a]/_resolution-0.5);
+    const int last = std::floor(max[a]/_resolution-0.5);
+    size[a] = std::max(0,last-first[a]+1);
+  }
+}
+
+size_t OccupancyGrid::numCells(const Eigen::Vector3f &min, const Eigen::Vector3f &max) const{
+  Eigen::Vector3i first, size;
+  bounds(min,max,first,size);
+  return size_t(size.x())*size.y()*size.z();
+}
+
+void OccupancyGrid::setBounds(const Eigen::Vector3f &min, const Eigen::Vector3f &max){
+  Eigen::Vector3i first, size;
+  bounds(min,max,first,size);
+  if(first == _first && size == _size)
+    return;
+
+  const size_t num_cells = size_t(size.x())*size.y()*size.z();
+  std::vector<float> log_odds(num_cells,0.0f);
+  std::vector<uint8_t> known(num_cells,0);
+
+  //copy the overlap, row by row
+  const Eigen::Vector3i overlap_first = first.cwiseMax(_first);
+  const Eigen::Vector3i overlap_last = (first+size).cwiseMin(_first+_size);
+  for(int z=overlap_first.z(); z<overlap_last.z(); ++z)
+    for(int y=overlap_first.y(); y<overlap_last.y(); ++y){
+      if(overlap_first.x() >= overlap_last.x())
+        break;
+      const size_t src = index(Eigen::Vector3i(overlap_first.x(),y,z)-_first);
+      const size_t dst = (size_t(z-first.z())*size.y()+(y-first.y()))*size.x()+(overlap_first.x()-first.x());
+      const size_t length = overlap_last.x()-overlap_first.x();
+      std::copy(_log_odds.begin()+src,_log_odds.begin()+src+length,log_odds.begin()+dst);
+      std::copy(_known.begin()+src,_known.begin()+src+length,known.begin()+dst);
+    }
+
+  _first = first;
+  _size = size;
+  _log_odds.swap(log_odds);
+  _known.swap(known);
+  _marks.assign(num_cells,0);
+}
+
+void OccupancyGrid::traceRay(const Eigen::Vector3f &origin, const Eigen::Vector3f &end){
+  const Eigen::Vector3i end_cell = key(end.x(),end.y(),end.z())-_first;
+
+  //clip the segment to the grid box (slabs)
+  const Eigen::Vector3f box_min = _first.cast<float>()*_resolution;
+  const Eigen::Vector3f box_max = (_first+_size).cast<float>()*_resolution;
+  const Eigen::Vector3f delta = end-origin;
+  const float length = delta.norm();
+  if(length > 0){
+    const Eigen::Vector3f direction = delta/length;
+    float t_min = 0, t_max = length;
+    for(int a=0; a<3 && t_min <= t_max; ++a){
+      if(std::abs(direction[a]) < 1e-9f){
+        if(origin[a] < box_min[a] || origin[a] >= box_max[a])
+          t_max = -1;
+        continue;
+      }
+      float t0 = (box_min[a]-origin[a])/direction[a];
+      float t1 = (box_max[a]-origin[a])/direction[a];
+      if(t0 > t1)
+        std::swap(t0,t1);
+      t_min = std::max(t_min,t0);
+      t_max = std::min(t_max,t1);
+    }
+
+    if(t_min <= t_max){
+      //3D-DDA from the entry point, the end voxel is not missed
+      const Eigen::Vector3f start = origin+direction*t_min;
+      Eigen::Vector3i cell = (key(start.x(),start.y(),start.z())-_first).cwiseMax(Eigen::Vector3i::Zero()).cwiseMin(_size-Eigen::Vector3i::Ones());
+      Eigen::Vector3i step;
+      Eigen::Vector3f t_next, t_delta;
+      for(int a=0; a<3; ++a){
+        if(direction[a] > 0){
+          step[a] = 1;
+          t_next[a] = t_min+((_first[a]+cell[a]+1)*_resolution-start[a])/direction[a];
+          t_delta[a] = _resolution/direction[a];
+        } else if(direction[a] < 0){
+          step[a] = -1;
+          t_next[a] = t_min+((_first[a]+cell[a])*_resolution-start[a])/direction[a];
+          t_delta[a] = -_resolution/direction[a];
+        } else {
+          step[a] = 0;
+          t_next[a] = std::numeric_limits<float>::max();
+          t_delta[a] = std::numeric_limits<float>::max();
+        }
+      }
+
+      while(cell != end_cell){
+        const size_t i = index(cell);
+        if(!_marks[i]){
+          _marks[i] = MISS;
+          _touched.push_back(i);
+        }
+
+        int a;
+        t_next.minCoeff(&a);
+        if(t_next[a] > t_max)
+          break;
+        cell[a] += step[a];
+        t_next[a] += t_delta[a];
+        if(cell[a] < 0 || cell[a] >= _size[a])
+          break;
+      }
+    }
+  }
+
+  if(inside(end_cell)){
+    const size_t i = index(end_cell);
+    if(!_marks[i])
+      _touched.push_back(i);
+    _marks[i] = HIT;
+  }
+}
+
+void OccupancyGrid::insertPointCloud(const octomap::Pointcloud &scan, const octomap::point3d &origin){
+  if(_log_odds.empty())
+    return;
+
+  const Eigen::Vector3f o(origin.x(),origin.y(),origin.z());
+  for(size_t i=0; i<scan.size(); ++i){
+    const octomap::point3d &p = scan.getPoint(i);
+    traceRay(o,Eigen::Vector3f(p.x(),p.y(),p.z()));
+  }
+
+  //one update per voxel, hits win over misses
+  for(size_t i : _touched){
+    const float value = (_known[i] ? _log_odds[i] : 0.0f)+(_marks[i] == HIT ? LOG_ODDS_HIT : LOG_ODDS_MISS);
+    _log_odds[i] = std::min(std::max(value,CLAMPING_MIN),CLAMPING_MAX);
+    _known[i] = 1;
+    _marks[i] = 0;
+  }
+  _touched.clear();
+}
+
+bool OccupancyGrid::castRay(const octomap::point3d &origin, const octomap::point3d &direction, octomap::point3d &end,
+                            bool ignore_unknown, double max_range) const{
+  end = origin;
+  if(_log_odds.empty())
+    return false;
+
+  const Eigen::Vector3f o(origin.x(),origin.y(),origin.z());
+  const Eigen::Vector3f d = Eigen::Vector3f(direction.x(),direction.y(),direction.z()).normalized();
+  const Eigen::Vector3f box_min = _first.cast<float>()*_resolution;
+  const Eigen::Vector3f box_max = (_first+_size).cast<float>()*_resolution;
+
+  float t_min = 0, t_max = max_range > 0 ? max_range : std::numeric_limits<float>::max();
+  for(int a=0; a<3; ++a){
+    if(std::abs(d[a]) < 1e-9f){
+      if(o[a] < box_min[a] || o[a] >= box_max[a])
+        return false;
+      continue;
+    }
+    float t0 = (box_min[a]-o[a])/d[a];
+    float t1 = (box_max[a]-o[a])/d[a];
+    if(t0 > t1)
+      std::swap(t0,t1);
+    t_min = std::max(t_min,t0);
+    t_max = std::min(t_max,t1);
+  }
+  if(t_min > t_max)
+    return false;
+
+  const Eigen::Vector3f start = o+d*t_min;
+  Eigen::Vector3i cell = (key(start.x(),start.y(),start.z())-_first).cwiseMax(Eigen::Vector3i::Zero()).cwiseMin(_size-Eigen::Vector3i::Ones());
+  Eigen::Vector3i step;
+  Eigen::Vector3f t_next, t_delta;
+  for(int a=0; a<3; ++a){
+    if(d[a] > 0){
+      step[a] = 1;
+      t_next[a] = t_min+((_first[a]+cell[a]+1)*_resolution-start[a])/d[a];
+      t_delta[a] = _resolution/d[a];
+    } else if(d[a] < 0){
+      step[a] = -1;
+      t_next[a] = t_min+((_first[a]+cell[a])*_resolution-start[a])/d[a];
+      t_delta[a] = -_resolution/d[a];
+    } else {
+      step[a] = 0;
+      t_next[a] = std::numeric_limits<float>::max();
+      t_delta[a] = std::numeric_limits<float>::max();
+    }
+  }
+
+  while(true){
+    const size_t i = index(cell);
+    if(_known[i] && _log_odds[i] >= OCCUPANCY_THRESHOLD){
+      end = cellCenter(i);
+      return true;
+    }
+    if(!_known[i] && !ignore_unknown){
+      end = cellCenter(i);
+      return false;
+    }
+
+    int a;
+    t_next.minCoeff(&a);
+    if(t_next[a] > t_max)
+      break;
+    cell[a] += step[a];
+    t_next[a] += t_delta[a];
+    if(cell[a] < 0 || cell[a] >= _size[a])
+      break;
+  }
+
+  const Eigen::Vector3f last = o+d*t_max;
+  end = octomap::point3d(last.x(),last.y(),last.z());
+  return false;
+}
+
+bool OccupancyGrid::search(const octomap::point3d &point, float &probability) const{
+  const Eigen::Vector3i cell = key(point.x(),point.y(),point.z())-_first;
+  if(!inside(cell))
+    return false;
+  const size_t i = index(cell);
+  if(!_known[i])
+    return false;
+  probability = occupancy(i);
+  return true;
+}
+
+octomap::point3d OccupancyGrid::cellCenter(size_t i) const{
+  const int x = i%_size.x();
+  const int y = (i/_size.x())%_size.y();
+  const int z = i/(size_t(_size.x())*_size.y());
+  return octomap::point3d((_first.x()+x+0.5)*_resolution,
+                          (_first.y()+y+0.5)*_resolution,
+                          (_first.z()+z+0.5)*_resolution);
+}
+
+octomap::OcTree *OccupancyGrid::exportOcTree() const{
+  octomap::OcTree *octree = new octomap::OcTree(_resolution);
+  for(size_t i=0; i<_log_odds.size(); ++i)
+    if(_known[i])
+      octree->setNodeValue(cellCenter(i),_log_odds[i],true);
+  octree->updateInnerOccupancy();
+  octree->prune();
+  return octree;
+}
+
+size_t OccupancyGrid::memoryUsage() const{
+  return sizeof(OccupancyGrid)+
+      _log_odds.capacity()*sizeof(float)+
+      _known.capacity()+
+      _marks.capacity()+
+      _touched.capacity()*sizeof(size_t);
+}
+
+void OccupancyGrid::write(std::string &buffer) const{
+  appendBinary(buffer,_resolution);
+  for(int a=0; a<3; ++a)
+    appendBinary(buffer,static_cast<int32_t>(_first[a]));
+  for(int a=0; a<3; ++a)
+    appendBinary(buffer,static_cast<int32_t>(_size[a]));
+  buffer.append(reinterpret_cast<const char*>(_log_odds.data()),_log_odds.size()*sizeof(float));
+  buffer.append(reinterpret_cast<const char*>(_known.data()),_known.size());
+}
+
+bool OccupancyGrid::read(const char* &data, const char *end){
+  int32_t first[3], size[3];
+  if(!readBinaryValue(data,end,_resolution))
+    return false;
+  for(int a=0; a<3; ++a)
+    if(!readBinaryValue(data,end,first[a]))
+      return false;
+  for(int a=0; a<3; ++a)
+    if(!readBinaryValue(data,end,size[a]) || size[a] < 0)
+      return false;
+
+  const size_t num_cells = size_t(size[0])*size[1]*size[2];
+  if(num_cells > MAX_CELLS || (size_t)(end-data) < num_cells*(sizeof(float)+1))
+    return false;
+
+  _first = Eigen::Vector3i(first[0],first[1],first[2]);
+  _size = Eigen::Vector3i(size[0],size[1],size[2]);
+  _log_odds.resize(num_cells);
+  memcpy(_log_odds.data(),data,num_cells*sizeof(float));
+  data += num_cells*sizeof(float);
+  _known.assign(data,data+num_cells);
+  data += num_cells;
+  _marks.assign(num_cells,0);
+  _touched.clear();
+  return true;
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cmath>
+
+#include <Eigen/Core>
+
+#include <octomap/OcTree.h>
+
+//this class is a dense occupancy grid bounded to the (inflated) box of an object, an alternative to the octree:
+//log-odds are stored in a flat array of voxels aligned with the octree keys, rays are traversed with a 3D-DDA
+//clipped to the box. Updates follow the octree sensor model (hit/miss log-odds, clamping, one update per
+//voxel and scan), insertPointCloud and castRay have the same signatures so the occupancy update is shared
+class OccupancyGrid{
+  public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    //largest grid, bigger objects use the octree
+    static const size_t MAX_CELLS = 1 << 21;
+
+    OccupancyGrid(double resolution = 0.05);
+
+    //voxels whose centers fall in [min,max], voxels of the current grid inside the new one are kept
+    void setBounds(const Eigen::Vector3f &min, const Eigen::Vector3f &max);
+
+    //number of voxels of a grid bounded by [min,max]
+    size_t numCells(const Eigen::Vector3f &min, const Eigen::Vector3f &max) const;
+
+    //integrate a scan: voxels between origin and the points are missed, voxels of the points are hit
+    void insertPointCloud(const octomap::Pointcloud &scan, const octomap::point3d &origin);
+
+    //true if the ray hits an occupied voxel (end is its center) within max_range (if positive).
+    //The path to the grid is considered free, unknown voxels stop the ray unless ignore_unknown
+    bool castRay(const octomap::point3d &origin, const octomap::point3d &direction, octomap::point3d &end,
+                 bool ignore_unknown = false, double max_range = -1.0) const;
+
+    //occupancy probability of the voxel at point, false if unknown or outside the grid
+    bool search(const octomap::point3d &point, float &probability) const;
+
+    //octree with the known voxels (for .bt export), the caller owns it
+    octomap::OcTree *exportOcTree() const;
+
+    //append the grid to buffer / read it back, data is moved past the record
+    void write(std::string &buffer) const;
+    bool read(const char* &data, const char *end);
+
+    //setters and getters
+    inline double resolution() const {return _resolution;}
+    inline size_t size() const {return _log_odds.size();}
+    inline bool known(size_t index) const {return _known[index];}
+    inline float logOdds(size_t index) const {return _log_odds[index];}
+    inline float occupancy(size_t index) const {return 1.0f/(1.0f+std::exp(-_log_odds[index]));}
+    octomap::point3d cellCenter(size_t index) const;
+    size_t memoryUsage() const;
+
+  private:
+    //first and last voxel key along each axis of the box [min,max]
+    void bounds(const Eigen::Vector3f &min, const Eigen::Vector3f &max, Eigen::Vector3i &first, Eigen::Vector3i &size) const;
+
+    inline Eigen::Vector3i key(float x, float y, float z) const {
+      return Eigen::Vector3i(std::floor(x/_resolution),std::floor(y/_resolution),std::floor(z/_resolution));
+    }
+    inline bool inside(const Eigen::Vector3i &cell) const {
+      return (cell.array() >= 0).all() && (cell.array() < _size.array()).all();
+    }
+    inline size_t index(const Eigen::Vector3i &cell) const {
+      return (size_t(cell.z())*_size.y()+cell.y())*_size.x()+cell.x();
+    }
+
+    //mark the voxels of the ray (clipped to the grid) as missed, the end voxel as hit
+    void traceRay(const Eigen::Vector3f &origin, const Eigen::Vector3f &end);
+
+    double _resolution;
+
+    //key of the first voxel and number of voxels along each axis
+    Eigen::Vector3i _first;
+    Eigen::Vector3i _size;
+
+    std::vector<float> _log_odds;
+    std::vector<uint8_t> _known;
+
+    //voxels updated by the current scan (1: miss, 2: hit) and their indices
+    std::vector<uint8_t> _marks;
+    std::vector<size_t> _touched;
+};
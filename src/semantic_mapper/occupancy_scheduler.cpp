@@ -0,0 +1,154 @@
+#include "occupancy_scheduler.h"
+
+#include <queue>
+#include <atomic>
+
+#include <utils/profiler.h>
+
+OccupancyScheduler::OccupancyScheduler(){
+  _staleness_weight = 1.0f;
+  _distance_weight = 1.0f;
+  _view_change_weight = 1.0f;
+
+  _min_view_distance = 0.0f;
+  _min_view_angle = 0.0f;
+  _downsample_stride = 1;
+
+  _executed = 0;
+  _superseded = 0;
+  _skipped = 0;
+  _downsampled = 0;
+}
+
+void OccupancyScheduler::schedule(const ObjectPtr &obj, const Eigen::Isometry3f &T, const PointCloud::Ptr &cloud){
+  if(!cloud || cloud->empty())
+    return;
+
+  std::lock_guard<std::mutex> lock(_mutex);
+  ObjectPtrRequestMap::iterator it = _pending.find(obj);
+  if(it != _pending.end()){
+    it->second.T = T;
+    it->second.cloud = cloud;
+    _superseded++;
+    return;
+  }
+
+  Request request;
+  request.T = T;
+  request.cloud = cloud;
+  request.stamp = getMonotonicTime();
+  _pending.insert(std::make_pair(obj,request));
+}
+
+float OccupancyScheduler::priority(const ObjectPtr &obj,
+                                   const Request &request,
+                                   const Eigen::Vector3f &robot_position,
+                                   double now) const{
+  const float staleness = now-request.stamp;
+  const float distance = (obj->position()-robot_position).norm();
+
+  //objects that were never processed have no volume at all
+  float view_change = 10.0f;
+  if(obj->numOccupancyUpdates()){
+    float angle;
+    obj->viewChange(request.T,view_change,angle);
+  }
+
+  return _staleness_weight*staleness +
+      _distance_weight/(1.0f+distance) +
+      _view_change_weight*view_change;
+}
+
+int OccupancyScheduler::process(const Eigen::Vector3f &robot_position, double budget, ThreadPool *pool){
+  const double start = getMonotonicTime();
+
+  //priorities are computed on a copy, the objects are read under their own lock
+  ObjectPtrRequestVector requests;
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if(_pending.empty())
+      return 0;
+    requests.assign(_pending.begin(),_pending.end());
+  }
+
+  typedef std::pair<float,ObjectPtr> PriorityObjectPair;
+  std::priority_queue<PriorityObjectPair> queue;
+  for(size_t i=0; i<requests.size(); ++i){
+    const ObjectPtr &obj = requests[i].first;
+    std::lock_guard<std::mutex> object_lock(obj->mutex());
+    queue.push(PriorityObjectPair(priority(obj,requests[i].second,robot_position,start),obj));
+  }
+
+  std::mutex queue_mutex;
+  std::atomic<int> executed(0), skipped(0), downsampled(0);
+  auto work = [&](int, int){
+    for(;;){
+      ObjectPtr obj;
+      {
+        std::lock_guard<std::mutex> queue_lock(queue_mutex);
+        if(queue.empty())
+          return;
+        if(budget >= 0 && executed && getMonotonicTime()-start >= budget)
+          return;
+
+        obj = queue.top().second;
+        queue.pop();
+      }
+
+      //take the latest request, unless another thread already did
+      Request request;
+      {
+        std::lock_guard<std::mutex> lock(_mutex);
+        ObjectPtrRequestMap::iterator it = _pending.find(obj);
+        if(it == _pending.end())
+          continue;
+        request = it->second;
+        _pending.erase(it);
+      }
+
+      std::lock_guard<std::mutex> object_lock(obj->mutex());
+
+      //the object was evicted meanwhile, its payload (and octree) is on disk
+      if(!obj->resident())
+        continue;
+
+      float distance = 0, angle = 0;
+      bool novel = true, nearly_novel = true;
+      if(obj->numOccupancyUpdates()){
+        obj->viewChange(request.T,distance,angle);
+        novel = distance >= _min_view_distance || angle >= _min_view_angle;
+        nearly_novel = distance >= 2*_min_view_distance || angle >= 2*_min_view_angle;
+      }
+
+      if(!novel){
+        //no new information from (almost) the same view
+        skipped++;
+      } else if(!nearly_novel && _downsample_stride > 1){
+        PointCloud::Ptr scan(new PointCloud());
+        scan->points.reserve(request.cloud->size()/_downsample_stride+1);
+        for(size_t i=0; i<request.cloud->size(); i+=_downsample_stride)
+          scan->points.push_back(request.cloud->points[i]);
+        scan->width = scan->size();
+        scan->height = 1;
+        obj->updateOccupancy(request.T,scan);
+        downsampled++;
+        executed++;
+      } else {
+        obj->updateOccupancy(request.T,request.cloud);
+        executed++;
+      }
+    }
+  };
+
+  //one loop per worker, all of them drain the queue
+  if(pool && queue.size() > 1)
+    pool->parallelFor(pool->size(),work);
+  else
+    work(0,0);
+
+  std::lock_guard<std::mutex> lock(_mutex);
+  _executed += executed;
+  _skipped += skipped;
+  _downsampled += downsampled;
+  return executed;
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <map>
+#include <vector>
+#include <mutex>
+
+#include <utils/thread_pool.h>
+
+#include "object.h"
+
+//this class defers object occupancy updates and runs them by priority within a cpu time budget,
+//so map geometry stays current every frame while volume estimates may lag.
+//It is thread safe: several cameras can schedule and process concurrently, each update runs
+//under the lock of its object and no scheduler lock is held while an object is locked
+class OccupancyScheduler{
+  public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    OccupancyScheduler();
+
+    //queue an update of obj from sensor pose T with the given scan,
+    //a pending update of the same object is replaced by the newer view
+    void schedule(const ObjectPtr &obj, const Eigen::Isometry3f &T, const PointCloud::Ptr &cloud);
+
+    //run pending updates by priority until budget seconds are spent (at least one runs per call),
+    //a negative budget runs all of them. Returns the number of executed updates.
+    //With a pool, its workers take the updates from the same priority queue
+    int process(const Eigen::Vector3f &robot_position, double budget, ThreadPool *pool = 0);
+
+    //setters and getters
+    inline size_t pending() const {std::lock_guard<std::mutex> lock(_mutex); return _pending.size();}
+    inline bool isPending(const ObjectPtr &obj) const {std::lock_guard<std::mutex> lock(_mutex); return _pending.count(obj) > 0;}
+    inline size_t executed() const {std::lock_guard<std::mutex> lock(_mutex); return _executed;}
+    inline size_t superseded() const {std::lock_guard<std::mutex> lock(_mutex); return _superseded;}
+    inline size_t skipped() const {std::lock_guard<std::mutex> lock(_mutex); return _skipped;}
+    inline size_t downsampled() const {std::lock_guard<std::mutex> lock(_mutex); return _downsampled;}
+
+    //fraction of the processed requests that were skipped by the view gate
+    inline float skipRate() const {
+      std::lock_guard<std::mutex> lock(_mutex);
+      return (_executed+_skipped) ? (float)_skipped/(_executed+_skipped) : 0.0f;
+    }
+
+    //view gate: an update is skipped if the sensor moved less than min_distance and turned less than min_angle
+    //since the last processed view, and its scan is downsampled by downsample_stride below twice those thresholds
+    inline void setViewGate(float min_distance, float min_angle, int downsample_stride){
+      _min_view_distance = min_distance;
+      _min_view_angle = min_angle;
+      _downsample_stride = downsample_stride;
+    }
+
+    inline float &stalenessWeight() {return _staleness_weight;}
+    inline float &distanceWeight() {return _distance_weight;}
+    inline float &viewChangeWeight() {return _view_change_weight;}
+
+  protected:
+
+    struct Request{
+      EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+      Eigen::Isometry3f T;
+      PointCloud::Ptr cloud;
+      //time of the oldest view that this request replaced
+      double stamp;
+    };
+    typedef std::map<ObjectPtr,Request,std::less<ObjectPtr>,
+    Eigen::aligned_allocator<std::pair<const ObjectPtr,Request> > > ObjectPtrRequestMap;
+    typedef std::vector<std::pair<ObjectPtr,Request>,
+    Eigen::aligned_allocator<std::pair<ObjectPtr,Request> > > ObjectPtrRequestVector;
+
+    //higher is more urgent: old requests, objects close to the robot and views far from the last processed one
+    float priority(const ObjectPtr &obj, const Request &request, const Eigen::Vector3f &robot_position, double now) const;
+
+    //one pending request per object
+    ObjectPtrRequestMap _pending;
+
+    //priority weights
+    float _staleness_weight;
+    float _distance_weight;
+    float _view_change_weight;
+
+    //view gate
+    float _min_view_distance;
+    float _min_view_angle;
+    int _downsample_stride;
+
+    //statistics
+    size_t _executed;
+    size_t _superseded;
+    size_t _skipped;
+    size_t _downsampled;
+
+    //guards the pending requests and the statistics
+    mutable std::mutex _mutex;
+};
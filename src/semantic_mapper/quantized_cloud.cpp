@@ -0,0 +1,82 @@
+#include "quantized_cloud.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+QuantizedCloud::QuantizedCloud():
+  _origin(Eigen::Vector3i::Zero()),
+  _step(0.001f){}
+
+void QuantizedCloud::clear(){
+  std::vector<uint16_t>().swap(_coordinates);
+  std::vector<uint8_t>().swap(_colors);
+}
+
+void QuantizedCloud::encode(const pcl::PointCloud<pcl::PointXYZRGB> &cloud, float step){
+  clear();
+  if(cloud.empty())
+    return;
+
+  Eigen::Vector3f min = Eigen::Vector3f::Constant(std::numeric_limits<float>::max());
+  Eigen::Vector3f max = Eigen::Vector3f::Constant(-std::numeric_limits<float>::max());
+  for(const pcl::PointXYZRGB &point : cloud.points){
+    min = min.cwiseMin(point.getVector3fMap());
+    max = max.cwiseMax(point.getVector3fMap());
+  }
+
+  //the origin is snapped to the grid, the cells are computed in double precision so that a
+  //float decoded from a cell is quantized back to the same cell
+  _step = step;
+  Eigen::Vector3d lower, upper;
+  for(;;){
+    lower = (min.cast<double>()/_step).array().floor();
+    upper = (max.cast<double>()/_step).array().round();
+    if((upper-lower).maxCoeff() <= 65535.0)
+      break;
+    _step *= 2;
+  }
+  _origin = lower.cast<int>();
+
+  _coordinates.resize(cloud.size()*3);
+  for(size_t i=0; i<cloud.size(); ++i){
+    const Eigen::Vector3d q = (cloud.points[i].getVector3fMap().cast<double>()/_step).array().round()-lower.array();
+    for(int a=0; a<3; ++a)
+      _coordinates[3*i+a] = q[a];
+  }
+
+  const pcl::PointXYZRGB &first = cloud.points[0];
+  bool uniform = true;
+  for(size_t i=1; i<cloud.size() && uniform; ++i)
+    uniform = cloud.points[i].r == first.r && cloud.points[i].g == first.g && cloud.points[i].b == first.b;
+
+  _colors.resize(uniform ? 3 : cloud.size()*3);
+  for(size_t i=0; i<_colors.size()/3; ++i){
+    const pcl::PointXYZRGB &point = cloud.points[i];
+    _colors[3*i] = point.r;
+    _colors[3*i+1] = point.g;
+    _colors[3*i+2] = point.b;
+  }
+}
+
+void QuantizedCloud::decode(pcl::PointCloud<pcl::PointXYZRGB> &cloud) const{
+  const size_t offset = cloud.size();
+  cloud.points.resize(offset+size());
+  decode(cloud.points.data()+offset);
+  cloud.width = cloud.points.size();
+  cloud.height = 1;
+}
+
+void QuantizedCloud::decode(pcl::PointXYZRGB *points) const{
+  const size_t color_stride = _colors.size() > 3 ? 3 : 0;
+  for(size_t i=0; i<size(); ++i){
+    pcl::PointXYZRGB &point = points[i];
+    point.x = (double)(_origin.x()+_coordinates[3*i])*_step;
+    point.y = (double)(_origin.y()+_coordinates[3*i+1])*_step;
+    point.z = (double)(_origin.z()+_coordinates[3*i+2])*_step;
+    const uint8_t *color = _colors.data()+color_stride*i;
+    point.r = color[0];
+    point.g = color[1];
+    point.b = color[2];
+  }
+}
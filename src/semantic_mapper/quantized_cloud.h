@@ -0,0 +1,51 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include <Eigen/Core>
+
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+//this class stores a colored cloud in 9 bytes per point: 16 bit coordinates on a regular grid
+//of the world frame and 8 bit colors (a pcl::PointXYZRGB takes 32 bytes).
+//A cloud of a single color (e.g. an object cloud or voxel centers) stores it once, 6 bytes per point.
+//The grid does not depend on the cloud extent, so points on a grid of the same step (e.g. voxel
+//centers, or a decoded cloud) are stored exactly and repeated merges do not drift
+class QuantizedCloud{
+  public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    QuantizedCloud();
+
+    //quantize cloud with the given step in meters. If the cloud spans more than 65535 steps the step is
+    //doubled until it fits: the coarse grid is a subset of the finer ones, so a point decoded from it
+    //is encoded again exactly with the same or a finer step
+    void encode(const pcl::PointCloud<pcl::PointXYZRGB> &cloud, float step);
+
+    //append the points to cloud
+    void decode(pcl::PointCloud<pcl::PointXYZRGB> &cloud) const;
+
+    //write the size() points to points (only xyz and rgb are set)
+    void decode(pcl::PointXYZRGB *points) const;
+
+    void clear();
+
+    //setters and getters
+    inline size_t size() const {return _coordinates.size()/3;}
+    inline bool empty() const {return _coordinates.empty();}
+    inline float step() const {return _step;}
+    inline size_t memoryUsage() const {return sizeof(QuantizedCloud)+_coordinates.capacity()*sizeof(uint16_t)+_colors.capacity();}
+
+  private:
+    //grid cell of the first coordinate
+    Eigen::Vector3i _origin;
+    float _step;
+
+    //xyz of each point in steps from the origin
+    std::vector<uint16_t> _coordinates;
+
+    //rgb of each point, or a single rgb if all the points have the same color
+    std::vector<uint8_t> _colors;
+};
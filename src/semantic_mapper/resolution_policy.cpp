@@ -0,0 +1,43 @@
+#include "resolution_policy.h"
+
+#include <algorithm>
+#include <cmath>
+
+ResolutionPolicy::ResolutionPolicy():
+  _default_resolution(0.05f),
+  _target_voxels(0),
+  _min_resolution(0.01f),
+  _max_resolution(0.2f),
+  _leaf_ratio(0.4f),
+  _dense_grid(false){}
+
+void ResolutionPolicy::setClassResolution(int class_id, float resolution){
+  if(class_id < 0)
+    return;
+  if(class_id >= (int)_class_resolutions.size())
+    _class_resolutions.resize(class_id+1,0.0f);
+  _class_resolutions[class_id] = resolution;
+}
+
+float ResolutionPolicy::resolution(const Object &obj) const{
+  const int class_id = obj.classId();
+  if(class_id >= 0 && class_id < (int)_class_resolutions.size() && _class_resolutions[class_id] > 0)
+    return _class_resolutions[class_id];
+
+  if(_target_voxels <= 0)
+    return _default_resolution;
+
+  //edge of the voxel that fills the (inflated) box with the target number of voxels,
+  //rounded to mm so that objects of similar size share the resolution
+  const Eigen::Vector3f extent = (obj.max()-obj.min()).cwiseMax(Eigen::Vector3f::Constant(_min_resolution));
+  const float edge = std::cbrt(extent.prod()/_target_voxels);
+  const float resolution = std::round(edge*1e3f)*1e-3f;
+  return std::min(std::max(resolution,_min_resolution),_max_resolution);
+}
+
+void ResolutionPolicy::apply(Object &obj) const{
+  const float octree_resolution = resolution(obj);
+  obj.setResolution(octree_resolution,leafSize(octree_resolution));
+  if(_dense_grid)
+    obj.useDenseGrid();
+}
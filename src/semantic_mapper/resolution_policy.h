@@ -0,0 +1,57 @@
+#pragma once
+
+#include <vector>
+
+#include "object.h"
+
+//this class chooses the octree resolution and the merge leaf size of an object when it is first observed:
+//from the class table if its class is listed, otherwise from its bounding box so that the box spans
+//about targetVoxels() voxels (if set), otherwise the default resolution.
+//The merge leaf is a fixed fraction of the octree resolution. Objects can also be set to use a dense grid
+//instead of the octree (see OccupancyGrid)
+class ResolutionPolicy{
+  public:
+    ResolutionPolicy();
+
+    //resolution of the objects of a class (meters)
+    void setClassResolution(int class_id, float resolution);
+
+    //resolution of an object
+    float resolution(const Object &obj) const;
+
+    //merge leaf size for an octree resolution
+    inline float leafSize(float resolution_) const {return resolution_*_leaf_ratio;}
+
+    //set resolution, leaf size and occupancy backend of a new object (its octree must still be empty)
+    void apply(Object &obj) const;
+
+    //setters and getters
+    inline float defaultResolution() const {return _default_resolution;}
+    inline void setDefaultResolution(float resolution_){_default_resolution = resolution_;}
+    inline int targetVoxels() const {return _target_voxels;}
+    inline void setTargetVoxels(int target_voxels_){_target_voxels = target_voxels_;}
+    inline float minResolution() const {return _min_resolution;}
+    inline float maxResolution() const {return _max_resolution;}
+    inline void setResolutionRange(float min_, float max_){_min_resolution = min_; _max_resolution = max_;}
+    inline float leafRatio() const {return _leaf_ratio;}
+    inline void setLeafRatio(float leaf_ratio_){_leaf_ratio = leaf_ratio_;}
+    inline bool denseGrid() const {return _dense_grid;}
+    inline void setDenseGrid(bool dense_grid_){_dense_grid = dense_grid_;}
+
+  private:
+    float _default_resolution;
+
+    //resolution by class id (0: not set)
+    std::vector<float> _class_resolutions;
+
+    //voxels spanned by the bounding box (0: disabled) and bounds of the resulting resolution
+    int _target_voxels;
+    float _min_resolution;
+    float _max_resolution;
+
+    //merge leaf size over octree resolution
+    float _leaf_ratio;
+
+    //dense grid instead of octree
+    bool _dense_grid;
+};
@@ -1,130 +1,342 @@
 #include "semantic_mapper.h"
 
-SemanticMapper::SemanticMapper(){
+#include <pcl/pcl_config.h>
+
+namespace {
+
+  //transform the rows of points (x, y, z, w columns) with the same floating point operations as
+  //pcl::transformPoint, as whole columns (SIMD through Eigen). The result is bit-identical to pcl with
+  //PCL >= 1.9, whose Transformer sums in a different order in SSE2 and scalar builds, as done here
+  template <class Input, class Output>
+  void transformPoints(const Eigen::Affine3f &transform, const Input &points, Output &&transformed){
+#if PCL_VERSION_COMPARE(>=,1,9,0)
+    const Eigen::Matrix4f &m = transform.matrix();
+#ifdef __SSE2__
+    //pcl::detail::Transformer<float>: the column products are summed starting from the translation,
+    //w is the fourth row (1, or NaN for non finite points)
+    for(int r=0; r<4; ++r)
+      transformed.col(r) = points.col(0)*m(r,0) + (points.col(1)*m(r,1) + (points.col(2)*m(r,2) + m(r,3)));
+#else
+    //pcl::detail::Transformer: the products are summed left to right, then the translation, w is kept
+    for(int r=0; r<3; ++r)
+      transformed.col(r) = ((points.col(0)*m(r,0) + points.col(1)*m(r,1)) + points.col(2)*m(r,2)) + m(r,3);
+    transformed.col(3) = points.col(3);
+#endif
+#else
+    //transform*point with Eigen as pcl::transformPoint, the rounding is not guaranteed to match, w is not modified
+    for(int i=0; i<points.rows(); ++i){
+      const Eigen::Vector3f p = transform*Eigen::Vector3f(points(i,0),points(i,1),points(i,2));
+      transformed(i,0) = p.x();
+      transformed(i,1) = p.y();
+      transformed(i,2) = p.z();
+      transformed(i,3) = points(i,3);
+    }
+#endif
+  }
+
+}
+
+SemanticMapper::SemanticMapper(const GlobalMapPtr &global_map):
+  _global_map(global_map){
+
+  if(!_global_map)
+    _global_map.reset(new GlobalMap());
 
   _local_map = new ObjectPtrVector();
-  _global_map = new ObjectPtrVector();
 
   _associations.clear();
+  _associated_size = 0;
+  _frame = 0;
 
   _local_set = false;
-  _global_set = false;
 
   _globalT.setIdentity();
 
+  _occupancy_budget = -1.0;
+
+  _K.setZero();
+  _width = 0;
+  _height = 0;
+
   _camera_offset.setIdentity();
   _camera_offset.linear() = Eigen::Quaternionf(0.5,-0.5,0.5,-0.5).toRotationMatrix();
 }
 
 SemanticMapper::~SemanticMapper(){
+  for(const ObjectPtr &obj : _spare_objects)
+    delete obj;
   delete _local_map;
-  delete _global_map;
 }
 
-void SemanticMapper::extractObjects(const DetectionVector &detections,
-                                    const PointCloud::ConstPtr & points){
+void SemanticMapper::setCameraMatrix(const Eigen::Matrix3f &K, int width, int height){
+  if(K == _K && width == _width && height == _height)
+    return;
 
-  //the first message populates the global map, the others populate the local map
-  bool populate_global = false;
-  if(!_global_set){
-    populate_global = true;
-    _global_set = true;
+  _K = K;
+  _width = width;
+  _height = height;
+
+  const Eigen::Matrix3f invK = K.inverse();
+  _ray_x.resize(width*height);
+  _ray_y.resize(width*height);
+  for(int r=0; r<height; ++r)
+    for(int c=0; c<width; ++c){
+      Eigen::Vector3f ray = invK*Eigen::Vector3f(c,r,1);
+      _ray_x[r*width+c] = ray.x()/ray.z();
+      _ray_y[r*width+c] = ray.y()/ray.z();
+    }
+}
+
+void SemanticMapper::unproject(const cv::Mat &depth_image, const PointCloud::Ptr &cloud){
+  if(depth_image.cols != _width || depth_image.rows != _height){
+    std::cerr << "[SemanticMapper] depth image size does not match the camera matrix" << std::endl;
+    return;
+  }
+
+  const int num_pixels = _width*_height;
+  _depth_buffer.resize(num_pixels);
+  float *depth = _depth_buffer.data();
+  const float nan = std::numeric_limits<float>::quiet_NaN();
+
+  //depth in meters, invalid pixels are NaN
+  if(depth_image.type() == CV_16UC1){
+    for(int r=0; r<_height; ++r){
+      const unsigned short *row = depth_image.ptr<unsigned short>(r);
+      float *d = depth + r*_width;
+      for(int c=0; c<_width; ++c)
+        d[c] = row[c] ? row[c]*1e-3f : nan;
+    }
+  } else if(depth_image.type() == CV_32FC1){
+    for(int r=0; r<_height; ++r){
+      const float *row = depth_image.ptr<float>(r);
+      float *d = depth + r*_width;
+      for(int c=0; c<_width; ++c)
+        d[c] = row[c] > 0.0f ? row[c] : nan;
+    }
   } else {
-    _local_map->clear();
-    _local_set = true;
+    std::cerr << "[SemanticMapper] unsupported depth image type" << std::endl;
+    return;
   }
 
-  size_t w=points->width;
+  cloud->width = _width;
+  cloud->height = _height;
+  cloud->is_dense = false;
+  cloud->points.resize(num_pixels);
+
+  const float *ray_x = _ray_x.data();
+  const float *ray_y = _ray_y.data();
+  Point *points = cloud->points.data();
+  for(int i=0; i<num_pixels; ++i){
+    points[i].x = ray_x[i]*depth[i];
+    points[i].y = ray_y[i]*depth[i];
+    points[i].z = depth[i];
+  }
+}
 
-  for(const Detection& detection : detections){
+void SemanticMapper::extractObjects(const DetectionVector &detections,
+                                    const PointCloud::ConstPtr & points){
+
+  _local_map->clear();
 
+  //the spare objects hand their clouds back before the pool forgets the clouds held elsewhere
+  for(const ObjectPtr &obj : _spare_objects)
+    obj->cloud().reset();
+  _cloud_pool.trim();
+  _frame = _global_map->nextFrame();
+
+  //the clouds are taken from the pool serially, the detections are then extracted in parallel
+  _extractions.clear();
+  for(const Detection& detection : detections){
     if(detection.pixels().size() < 10)
       continue;
 
-    std::string model = detection.type();
-    Eigen::Vector3f color = detection.color().cast<float>()/255.0f;
+    Extraction extraction;
+    extraction.detection = &detection;
+    extraction.cloud = _cloud_pool.acquire(detection.pixels().size());
+    _extractions.push_back(extraction);
+  }
 
-    const std::vector<Eigen::Vector2i> &pixels = detection.pixels();
-    int num_pixels = pixels.size();
-    PointCloud::Ptr cloud (new PointCloud());
-    cloud->resize(num_pixels);
-    int k=0;
+  //camera to map, composed once per frame
+  const Eigen::Affine3f transform = _globalT*_camera_offset;
 
-    Eigen::Vector3f min(std::numeric_limits<float>::max(),std::numeric_limits<float>::max(),std::numeric_limits<float>::max());
-    Eigen::Vector3f max(-std::numeric_limits<float>::max(),-std::numeric_limits<float>::max(),-std::numeric_limits<float>::max());
-    Eigen::Vector3f position = Eigen::Vector3f::Zero();
+  _batches.resize(_thread_pool ? _thread_pool->size() : 1);
+  forEach(_extractions.size(),[this,&transform,&points](int i, int worker){
+    extractPoints(transform,points,_batches[worker],_extractions[i]);
+  });
 
-    for(int i=0; i<num_pixels; ++i){
+  //objects are created in detection order, whatever the number of threads
+  for(Extraction &extraction : _extractions){
 
-      Point point = points->at(pixels[i].y(),pixels[i].x());
+    //check if object is empty
+    if(extraction.cloud->empty()){
+      extraction.cloud.reset();
+      continue;
+    }
 
-      if(std::sqrt(point.x*point.x + point.y*point.y + point.z*point.z) < 1e-3 || point.z <= 0.1)
-        continue;
+    const Detection &detection = *extraction.detection;
+    const std::string &model = detection.type();
+    Eigen::Vector3f color = detection.color().cast<float>()/255.0f;
+    const Eigen::Vector3f position = (extraction.min+extraction.max)/2.0f;
 
-      point = pcl::transformPoint(point,_globalT*_camera_offset);
-
-      point.r = color.z()*255;
-      point.g = color.y()*255;
-      point.b = color.x()*255;
-
-      cloud->at(k) = point;
-      k++;
-      if(point.x < min.x())
-        min.x() = point.x;
-      if(point.x > max.x())
-        max.x() = point.x;
-      if(point.y < min.y())
-        min.y() = point.y;
-      if(point.y > max.y())
-        max.y() = point.y;
-      if(point.z < min.z())
-        min.z() = point.z;
-      if(point.z > max.z())
-        max.z() = point.z;
+    ObjectPtr obj_ptr;
+    if(_spare_objects.empty()){
+      obj_ptr = new Object(model,position,extraction.min,extraction.max,color,extraction.cloud);
+    } else {
+      obj_ptr = _spare_objects.back();
+      _spare_objects.pop_back();
+      obj_ptr->reset(model,position,extraction.min,extraction.max,color,extraction.cloud);
     }
+    extraction.cloud.reset();
+    obj_ptr->classId() = detection.classId();
+    obj_ptr->setLastObserved(_frame);
+    _global_map->resolutionPolicy().apply(*obj_ptr);
+    _local_map->push_back(obj_ptr);
+  }
 
-    //check if object is empty
-    if(!k)
+  //the first frame (of any camera) populates the global map, the others populate the local map.
+  //Occupancy of local objects is computed only if they are added to the global map
+  _local_set = false;
+  if(!_global_map->initialized()){
+    GlobalMap::ExclusiveLock lock(_global_map->mutex());
+    if(!_global_map->initialized()){
+      for(const ObjectPtr &obj : *_local_map){
+        _global_map->occupancyScheduler().schedule(obj,_globalT,obj->cloud());
+        obj->compact();
+        _global_map->objects()->push_back(obj);
+      }
+      _local_map->clear();
+      _global_map->setInitialized();
+      return;
+    }
+  }
+  _local_set = true;
+}
+
+void SemanticMapper::extractPoints(const Eigen::Affine3f &transform,
+                                   const PointCloud::ConstPtr &points,
+                                   Batch &batch,
+                                   Extraction &extraction) const{
+
+  const Detection &detection = *extraction.detection;
+  const bool dense = _sampler.dense();
+
+  Eigen::Vector3f color = detection.color().cast<float>()/255.0f;
+
+  const std::vector<Eigen::Vector2i> &pixels = detection.pixels();
+  int num_pixels = pixels.size();
+  PointCloud::Ptr &cloud = extraction.cloud;
+  Point *cloud_points = cloud->points.data();
+  if(batch.points.rows() < num_pixels){
+    batch.points.resize(num_pixels,4);
+    batch.transformed.resize(num_pixels,4);
+  }
+
+  //gather the valid points: the whole point is copied (its other fields are kept), the coordinates are batched
+  int k=0;
+  for(int i=0; i<num_pixels; ++i){
+
+    const Point &point = points->at(pixels[i].y(),pixels[i].x());
+
+    //a point closer than 1mm is also closer than 10cm, the range is only needed by the sampler
+    if(point.z <= 0.1)
       continue;
 
-    cloud->resize(k);
-    position = (min+max)/2.0f;
+    if(!dense){
+      const float range = std::sqrt(point.x*point.x + point.y*point.y + point.z*point.z);
+      if(!_sampler.keep(pixels[i].x(),pixels[i].y(),range))
+        continue;
+    }
+
+    cloud_points[k] = point;
+    batch.points(k,0) = point.x;
+    batch.points(k,1) = point.y;
+    batch.points(k,2) = point.z;
+    batch.points(k,3) = point.data[3];
+    k++;
+  }
+
+  cloud->resize(k);
+  if(!k)
+    return;
 
-    ObjectPtr obj_ptr (new Object(model,position,min,max,color,cloud));
-    obj_ptr->updateOccupancy(_globalT,cloud);
+  transformPoints(transform,batch.points.topRows(k),batch.transformed.topRows(k));
+
+  //bounding box, NaN coordinates are skipped as by the comparisons of a scalar loop
+  Eigen::Vector3f &min = extraction.min;
+  Eigen::Vector3f &max = extraction.max;
+  min.setConstant(std::numeric_limits<float>::max());
+  max.setConstant(-std::numeric_limits<float>::max());
+  for(int a=0; a<3; ++a){
+    const float *values = batch.transformed.col(a).data();
+    float lower = min[a];
+    float upper = max[a];
+    for(int i=0; i<k; ++i){
+      lower = values[i] < lower ? values[i] : lower;
+      upper = values[i] > upper ? values[i] : upper;
+    }
+    min[a] = lower;
+    max[a] = upper;
+  }
 
-    if(populate_global)
-      _global_map->push_back(obj_ptr);
-    else
-      _local_map->push_back(obj_ptr);
+  //scatter the coordinates and fill the object color
+  const uint8_t r = color.z()*255;
+  const uint8_t g = color.y()*255;
+  const uint8_t b = color.x()*255;
+  for(int i=0; i<k; ++i){
+    Point &point = cloud_points[i];
+    point.x = batch.transformed(i,0);
+    point.y = batch.transformed(i,1);
+    point.z = batch.transformed(i,2);
+    point.data[3] = batch.transformed(i,3);
+    point.r = r;
+    point.g = g;
+    point.b = b;
+  }
+}
 
+void SemanticMapper::forEach(int n, const ThreadPool::Task &task){
+  if(_thread_pool){
+    _thread_pool->parallelFor(n,task);
+    return;
   }
+  for(int i=0; i<n; ++i)
+    task(i,0);
 }
 
 void SemanticMapper::findAssociations(){
-  if(!_global_set || !_local_set)
+  if(!_global_map->initialized() || !_local_set)
     return;
 
+  GlobalMap::SharedLock lock(_global_map->mutex());
+  const ObjectPtrVector &global_map = *_global_map->objects();
+
   const int local_size = _local_map->size();
-  const int global_size = _global_map->size();
+  const int global_size = global_map.size();
+  _associated_size = global_size;
 
   _associations.clear();
 
   for(int i=0; i < global_size; ++i){
-    const ObjectPtr &global = (*_global_map)[i];
-    const std::string &global_model = global->model();
+    const ObjectPtr &global = global_map[i];
+    const int global_class = global->classId();
+
+    //other cameras may be merging into this object
+    Eigen::Vector3f global_position;
+    {
+      std::lock_guard<std::mutex> object_lock(global->mutex());
+      global_position = global->position();
+    }
 
     ObjectPtr local_best = nullptr;
     float best_error = std::numeric_limits<float>::max();
 
     for(int j=0; j < local_size; ++j){
       const ObjectPtr &local = (*_local_map)[j];
-      const std::string &local_model = local->model();
 
-      if(local_model != global_model)
+      if(local->classId() != global_class)
         continue;
 
-      Eigen::Vector3f e_c = local->position() - global->position();
+      Eigen::Vector3f e_c = local->position() - global_position;
 
       float error = e_c.transpose()*e_c;
 
@@ -141,28 +353,121 @@ void SemanticMapper::findAssociations(){
 }
 
 void SemanticMapper::mergeMaps(){
-  if(!_global_set || !_local_set)
-    return;
+  if(_global_map->initialized() && _local_set){
+    OccupancyScheduler &scheduler = _global_map->occupancyScheduler();
+    ObjectPtrVector additions;
+
+    {
+      GlobalMap::SharedLock lock(_global_map->mutex());
+      const ObjectPtrVector &global_map = *_global_map->objects();
+
+      //each global object is associated to at most one local object, the merges run in parallel
+      const int local_size = _local_map->size();
+      _added.assign(local_size,0);
+      forEach(local_size,[this,&global_map,&scheduler](int i, int){
+        const ObjectPtr &local = (*_local_map)[i];
+        ObjectPtrIdMap::const_iterator it = _associations.find(local);
+        if(it == _associations.end()){
+          _added[i] = 1;
+          return;
+        }
+
+        const ObjectPtr &global_associated = global_map[it->second];
+        if(local->classId() != global_associated->classId())
+          return;
+
+        //the payload of an evicted object is being loaded, this observation is dropped
+        {
+          std::lock_guard<std::mutex> object_lock(global_associated->mutex());
+          if(!global_associated->resident())
+            return;
+        }
+
+        //the scheduler lock is never taken while holding an object lock
+        scheduler.schedule(global_associated,_globalT,local->cloud());
+
+        std::lock_guard<std::mutex> object_lock(global_associated->mutex());
+        if(global_associated->resident())
+          global_associated->merge(local);
+      });
+
+      //from here on the merged local objects are only read, they are recycled by the next frame.
+      //New objects keep the detection order
+      for(int i=0; i<local_size; ++i){
+        const ObjectPtr &local = (*_local_map)[i];
+        if(_added[i])
+          additions.push_back(local);
+        else
+          _spare_objects.push_back(local);
+      }
+    }
 
-  int added = 0, merged = 0;
+    if(!additions.empty())
+      addObjects(additions);
 
-  for(int i=0; i<_local_map->size(); ++i){
-    const ObjectPtr &local = (*_local_map)[i];
-    ObjectPtrIdMap::iterator it = _associations.find(local);
-    int association_id = -1;
-    if(it != _associations.end()){
-      association_id = it->second;
-      ObjectPtr &global_associated = (*_global_map)[association_id];
+    //the local map is consumed (its objects are in the global map or recycled)
+    _local_set = false;
+  }
+
+  //updates that do not fit in the budget stay queued for the next frames
+  _global_map->processOccupancy(_globalT.translation(),_occupancy_budget,_thread_pool.get());
+
+  _global_map->freezeStale(_frame);
+
+  _global_map->updateTiles(_globalT.translation());
+
+  //readers see the merged map from now on
+  _global_map->publish();
+}
 
-      if(local->model() != global_associated->model())
+void SemanticMapper::addObjects(const ObjectPtrVector &additions){
+  GlobalMap::ExclusiveLock lock(_global_map->mutex());
+  ObjectPtrVector &global_map = *_global_map->objects();
+  OccupancyScheduler &scheduler = _global_map->occupancyScheduler();
+
+  //same association rule as findAssociations, restricted to the objects added meanwhile
+  ObjectPtrIdMap late_associations;
+  for(size_t i=_associated_size; i < global_map.size(); ++i){
+    const ObjectPtr &global = global_map[i];
+    ObjectPtr local_best = nullptr;
+    float best_error = std::numeric_limits<float>::max();
+    for(const ObjectPtr &local : additions){
+      if(local->classId() != global->classId())
         continue;
+      const float error = (local->position() - global->position()).squaredNorm();
+      if(error < best_error){
+        best_error = error;
+        local_best = local;
+      }
+    }
+    if(local_best)
+      late_associations[local_best] = i;
+  }
 
-      global_associated->updateOccupancy(_globalT,local->cloud());
-      global_associated->merge(local);
-      merged++;
-    } else {
-      _global_map->push_back(local);
-      added++;
+  for(const ObjectPtr &local : additions){
+    ObjectPtrIdMap::iterator it = late_associations.find(local);
+    if(it == late_associations.end()){
+      //the scheduler keeps the raw cloud as the scan of the occupancy update
+      scheduler.schedule(local,_globalT,local->cloud());
+      local->compact();
+      global_map.push_back(local);
+      continue;
     }
+
+    //no tile is evicted or loaded under the exclusive lock
+    const ObjectPtr &global = global_map[it->second];
+    if(global->resident()){
+      scheduler.schedule(global,_globalT,local->cloud());
+      global->merge(local);
+    }
+    _spare_objects.push_back(local);
   }
 }
+
+int SemanticMapper::processPendingOccupancy(double budget){
+  return _global_map->processOccupancy(_globalT.translation(),budget,_thread_pool.get());
+}
+
+void SemanticMapper::restoreGlobalMap(const ObjectPtrVector &objects){
+  _global_map->restore(objects);
+}
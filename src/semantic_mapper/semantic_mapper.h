@@ -6,33 +6,83 @@
 #include <opencv2/highgui.hpp>
 
 #include <object_detector/detection.h>
+#include <utils/pixel_sampler.h>
+#include <utils/thread_pool.h>
 
 #include "object.h"
+#include "global_map.h"
+#include "cloud_pool.h"
 
 class SemanticMapper{
   public:
     EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 
-    SemanticMapper();
+    //mappers of different cameras share global_map, a new map is created if it is null
+    SemanticMapper(const GlobalMapPtr &global_map = GlobalMapPtr());
 
     virtual ~SemanticMapper();
 
     //set robot pose
     inline void setGlobalT(const Eigen::Isometry3f &globalT_){_globalT = globalT_;}
 
-    //specialized extractObjects method
+    //compute the per-pixel ray table from the depth camera matrix (once per camera)
+    void setCameraMatrix(const Eigen::Matrix3f &K, int width, int height);
+    inline bool hasRayTable() const {return !_ray_x.empty();}
+
+    //unproject a depth image (16UC1 in mm or 32FC1 in m) into an organized cloud in the camera optical frame,
+    //invalid pixels are set to NaN as in the clouds published by the depth camera
+    void unproject(const cv::Mat &depth_image, const PointCloud::Ptr &cloud);
+
+    //specialized extractObjects method. The local objects merged (or dropped) by the previous mergeMaps
+    //and their clouds are recycled, the mapper owns them until then.
+    //Detections are extracted in parallel (see setThreadPool), objects are created in detection order
     void extractObjects(const DetectionVector &detections,
                         const PointCloud::ConstPtr &points);
 
     //specialized findAssociations method
     void findAssociations();
 
-    //specialized mergeMaps method
+    //specialized mergeMaps method, ends with the occupancy updates that fit in the frame budget.
+    //Merges lock only the merged objects (thawing them if frozen) and run in parallel, new objects are appended
+    //in detection order under the exclusive map lock, stale objects are frozen, then a new snapshot of the global map is published
     void mergeMaps();
 
-    const ObjectPtrVector* globalMap() const {return _global_map;}
+    //run deferred occupancy updates (e.g. when idle), a negative budget runs all of them
+    int processPendingOccupancy(double budget);
+
+    //per-object steps (extraction, merges, occupancy updates) run on the pool, serially if it is null.
+    //A pool can be shared by the mappers of several cameras
+    inline void setThreadPool(const ThreadPoolPtr &pool) {_thread_pool = pool;}
+    inline const ThreadPoolPtr &threadPool() const {return _thread_pool;}
+
+    //pixels of each detection used by extractObjects (stride and distance bands)
+    inline const PixelSampler &sampler() const {return _sampler;}
+    inline PixelSampler &sampler() {return _sampler;}
+
+    //per-frame cpu time budget for occupancy updates in seconds (negative: unbounded)
+    inline void setOccupancyBudget(double budget_){_occupancy_budget = budget_;}
+    inline const OccupancyScheduler &occupancyScheduler() const {return _global_map->occupancyScheduler();}
+    inline OccupancyScheduler &occupancyScheduler() {return _global_map->occupancyScheduler();}
+
+    //octree resolution and merge leaf of new objects
+    inline const ResolutionPolicy &resolutionPolicy() const {return _global_map->resolutionPolicy();}
+    inline ResolutionPolicy &resolutionPolicy() {return _global_map->resolutionPolicy();}
+
+    //out-of-core storage of the far away objects (disabled until setup)
+    inline const TileManager &tiles() const {return _global_map->tiles();}
+    inline TileManager &tiles() {return _global_map->tiles();}
+
+    //append objects restored from disk to the global map (ownership is transferred)
+    void restoreGlobalMap(const ObjectPtrVector &objects);
+
+    //the global map is shared by several cameras: lock sharedMap()->mutex() to read it while they are running
+    const ObjectPtrVector* globalMap() const {return _global_map->objects();}
+    inline const GlobalMapPtr &sharedMap() const {return _global_map;}
     const ObjectPtrVector* localMap() const {return _local_map;}
 
+    //clouds of the local objects, recycled across frames
+    inline const CloudPool &cloudPool() const {return _cloud_pool;}
+
     const ObjectPtrIdMap& associations() const {return _associations;}
 
   protected:
@@ -42,16 +92,77 @@ class SemanticMapper{
 
     Eigen::Isometry3f _camera_offset;
 
+    //pixel sampling for extraction
+    PixelSampler _sampler;
+
+    //camera matrix and per-pixel ray table (z component is 1)
+    Eigen::Matrix3f _K;
+    int _width;
+    int _height;
+    std::vector<float> _ray_x;
+    std::vector<float> _ray_y;
+    std::vector<float> _depth_buffer;
+
+    //valid points of a detection (x, y, z, w columns) before and after the transform, one per worker
+    struct Batch{
+      Eigen::ArrayX4f points;
+      Eigen::ArrayX4f transformed;
+    };
+    std::vector<Batch> _batches;
+
+    //cloud and bounding box extracted from a detection
+    struct Extraction{
+      EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+      const Detection *detection;
+      PointCloud::Ptr cloud;
+      Eigen::Vector3f min;
+      Eigen::Vector3f max;
+    };
+    typedef std::vector<Extraction,Eigen::aligned_allocator<Extraction> > ExtractionVector;
+    ExtractionVector _extractions;
+
+    //local objects that mergeMaps appends to the global map
+    std::vector<char> _added;
+
+    //workers of the per-object steps (null: serial)
+    ThreadPoolPtr _thread_pool;
+
     //flags
     bool _local_set;
-    bool _global_set;
 
     //map built from the current frame
     ObjectPtrVector *_local_map;
 
     //actual map that stores objects in a global reference frame and gets updated for each new observation
-    ObjectPtrVector *_global_map;
+    GlobalMapPtr _global_map;
 
     //this map stores the output of the data-association
     ObjectPtrIdMap _associations;
+
+    //size of the global map seen by findAssociations, later objects were added by other cameras
+    size_t _associated_size;
+
+    //frame budget of the occupancy updates
+    double _occupancy_budget;
+
+    //global frame of the current observations (see GlobalMap::nextFrame)
+    uint64_t _frame;
+
+    //local objects not added to the global map and the clouds of the local objects, reused by the next frames
+    ObjectPtrVector _spare_objects;
+    CloudPool _cloud_pool;
+
+  private:
+    //fill the cloud and bounding box of an extraction (empty cloud if no point is valid), thread safe
+    void extractPoints(const Eigen::Affine3f &transform,
+                       const PointCloud::ConstPtr &points,
+                       Batch &batch,
+                       Extraction &extraction) const;
+
+    //run task(i,worker) for i in [0,n) on the pool
+    void forEach(int n, const ThreadPool::Task &task);
+
+    //append new objects to the global map (under the exclusive lock), merging them into
+    //the objects that other cameras added after findAssociations
+    void addObjects(const ObjectPtrVector &additions);
 };
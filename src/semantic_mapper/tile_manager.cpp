@@ -0,0 +1,200 @@
+#include "tile_manager.h"
+
+#include <cmath>
+#include <algorithm>
+#include <cstdio>
+#include <sstream>
+#include <fstream>
+#include <iterator>
+
+TileManager::TileManager(){
+  _tile_size = 10.0f;
+  _load_radius = 15.0f;
+  _evict_radius = 25.0f;
+  _resident = 0;
+  _evicted = 0;
+  _evictions = 0;
+  _loads = 0;
+  _running = false;
+  _busy = false;
+}
+
+TileManager::~TileManager(){
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _running = false;
+  }
+  _condition.notify_all();
+  if(_thread.joinable())
+    _thread.join();
+}
+
+void TileManager::setup(const std::string &directory, float tile_size, float load_radius, float evict_radius){
+  _directory = directory;
+  if(!_directory.empty() && _directory[_directory.size()-1] != '/')
+    _directory += "/";
+  _tile_size = tile_size;
+  _load_radius = load_radius;
+  _evict_radius = std::max(evict_radius,load_radius);
+
+  std::lock_guard<std::mutex> lock(_mutex);
+  if(_running || _directory.empty())
+    return;
+  _running = true;
+  _thread = std::thread(&TileManager::run,this);
+}
+
+float TileManager::tileDistance(const Eigen::Vector3f &position, const Eigen::Vector3f &robot_position) const{
+  const float x_min = std::floor(position.x()/_tile_size)*_tile_size;
+  const float y_min = std::floor(position.y()/_tile_size)*_tile_size;
+  const float dx = std::max(std::max(x_min-robot_position.x(),robot_position.x()-(x_min+_tile_size)),0.0f);
+  const float dy = std::max(std::max(y_min-robot_position.y(),robot_position.y()-(y_min+_tile_size)),0.0f);
+  return std::sqrt(dx*dx+dy*dy);
+}
+
+void TileManager::update(const ObjectPtrVector *map,
+                         const Eigen::Vector3f &robot_position,
+                         const OccupancyScheduler &scheduler){
+  if(!enabled())
+    return;
+
+  std::deque<Job> loaded, written;
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    loaded.swap(_loaded);
+    written.swap(_written);
+  }
+
+  //attach the payloads read by the I/O thread
+  for(const Job &job : loaded){
+    const ObjectPtr &obj = map->at(job.index);
+    _loading.erase(job.index);
+    if(!obj->resident() && !obj->attach(job.data)){
+      std::cerr << "[TileManager] cannot load " << job.filename << std::endl;
+      if(++_load_failures[job.index] >= MAX_LOAD_ATTEMPTS){
+        std::cerr << "[TileManager] giving up " << job.filename << ", the object keeps its box only" << std::endl;
+        obj->discardPayload();
+        _load_failures.erase(job.index);
+      }
+      continue;
+    }
+    _load_failures.erase(job.index);
+    _loads++;
+  }
+
+  //release the payloads on disk, unless the object changed meanwhile (it is written again later)
+  for(const Job &job : written){
+    const ObjectPtr &obj = map->at(job.index);
+    _writing.erase(job.index);
+    if(!job.ok || !obj->resident() || scheduler.isPending(obj) ||
+       obj->revision() != job.revision || obj->numOccupancyUpdates() != job.num_occupancy_updates)
+      continue;
+    obj->evict(job.filename);
+    _evictions++;
+  }
+
+  _resident = 0;
+  _evicted = 0;
+  for(size_t i=0; i<map->size(); ++i){
+    const ObjectPtr &obj = map->at(i);
+    const float distance = tileDistance(obj->position(),robot_position);
+
+    if(obj->resident()){
+      if(distance > _evict_radius && !scheduler.isPending(obj) && !_writing.count(i)){
+        std::ostringstream filename;
+        filename << _directory << "tile_"
+                 << (int)std::floor(obj->position().x()/_tile_size) << "_"
+                 << (int)std::floor(obj->position().y()/_tile_size) << "_"
+                 << i << ".obj";
+
+        Job job;
+        job.load = false;
+        job.index = i;
+        job.filename = filename.str();
+        job.revision = obj->revision();
+        job.num_occupancy_updates = obj->numOccupancyUpdates();
+        obj->writeBinary(job.data);
+        push(job);
+        _writing.insert(i);
+      }
+      _resident++;
+      continue;
+    }
+
+    _evicted++;
+    if(distance < _load_radius && !_loading.count(i)){
+      Job job;
+      job.load = true;
+      job.index = i;
+      job.filename = obj->payloadFilename();
+      push(job);
+      _loading.insert(i);
+    }
+  }
+}
+
+void TileManager::flush(){
+  std::unique_lock<std::mutex> lock(_mutex);
+  while(_running && (_busy || !_jobs.empty()))
+    _condition.wait(lock);
+}
+
+void TileManager::push(Job &job){
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _jobs.push_back(Job());
+    _jobs.back().load = job.load;
+    _jobs.back().ok = false;
+    _jobs.back().index = job.index;
+    _jobs.back().revision = job.revision;
+    _jobs.back().num_occupancy_updates = job.num_occupancy_updates;
+    _jobs.back().filename.swap(job.filename);
+    _jobs.back().data.swap(job.data);
+  }
+  _condition.notify_all();
+}
+
+void TileManager::run(){
+  std::unique_lock<std::mutex> lock(_mutex);
+  while(_running || !_jobs.empty()){
+    if(_jobs.empty()){
+      _condition.wait(lock);
+      continue;
+    }
+
+    Job job;
+    job.load = _jobs.front().load;
+    job.index = _jobs.front().index;
+    job.revision = _jobs.front().revision;
+    job.num_occupancy_updates = _jobs.front().num_occupancy_updates;
+    job.filename.swap(_jobs.front().filename);
+    job.data.swap(_jobs.front().data);
+    _jobs.pop_front();
+    _busy = true;
+    lock.unlock();
+
+    //the queue is FIFO, so a payload is always written before it is read back
+    if(job.load){
+      std::ifstream file(job.filename.c_str(),std::ios::binary);
+      job.data.assign(std::istreambuf_iterator<char>(file),std::istreambuf_iterator<char>());
+      job.ok = true;
+    } else {
+      //the object keeps its payload until the write succeeded
+      FILE *file = fopen(job.filename.c_str(),"wb");
+      job.ok = file && fwrite(job.data.data(),1,job.data.size(),file) == job.data.size();
+      if(file && fclose(file))
+        job.ok = false;
+      if(!job.ok)
+        std::cerr << "[TileManager] cannot write " << job.filename << std::endl;
+      job.data.clear();
+    }
+
+    lock.lock();
+    if(job.load)
+      _loaded.push_back(job);
+    else
+      _written.push_back(job);
+    _busy = false;
+    _condition.notify_all();
+  }
+}
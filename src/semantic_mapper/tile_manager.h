@@ -0,0 +1,101 @@
+#pragma once
+
+#include <string>
+#include <deque>
+#include <set>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "object.h"
+#include "occupancy_scheduler.h"
+
+//this class bounds the memory of the global map by the working set around the robot:
+//the map is split into square tiles on the xy plane, objects in tiles beyond the eviction radius
+//keep only their boxes once their payload is written to disk, and are loaded back in the background
+//when the robot comes within the load radius. Files are read and written by an I/O thread,
+//payloads are released (only after their write succeeded) and attached on the mapper thread
+class TileManager{
+  public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    TileManager();
+
+    ~TileManager();
+
+    //directory of the payload files, starts the I/O thread.
+    //load_radius should exceed the sensor range and be smaller than evict_radius (hysteresis)
+    void setup(const std::string &directory, float tile_size, float load_radius, float evict_radius);
+
+    inline bool enabled() const {return !_directory.empty();}
+
+    //attach the payloads loaded and release the payloads written since the last call, then write the far
+    //tiles and request the near ones. Objects with a pending occupancy update, or changed while their
+    //payload was written, are not evicted. A payload that cannot be read is requested again
+    //up to MAX_LOAD_ATTEMPTS times, then the object is kept with its box only
+    void update(const ObjectPtrVector *map, const Eigen::Vector3f &robot_position, const OccupancyScheduler &scheduler);
+
+    //wait until the queued writes are on disk (e.g. before a snapshot reads evicted records)
+    void flush();
+
+    //setters and getters
+    inline float tileSize() const {return _tile_size;}
+    inline size_t residentObjects() const {return _resident;}
+    inline size_t evictedObjects() const {return _evicted;}
+    inline size_t loading() const {return _loading.size();}
+    inline size_t evictions() const {return _evictions;}
+    inline size_t loads() const {return _loads;}
+
+    static const int MAX_LOAD_ATTEMPTS = 3;
+
+  protected:
+
+    struct Job{
+      bool load;
+      bool ok;
+      size_t index;
+      std::string filename;
+      std::string data;
+
+      //state of the object when its payload was serialized (writes only)
+      int revision;
+      int num_occupancy_updates;
+    };
+
+    //distance on the xy plane between a position and the closest point of its tile
+    float tileDistance(const Eigen::Vector3f &position, const Eigen::Vector3f &robot_position) const;
+
+    void push(Job &job);
+    void run();
+
+    std::string _directory;
+    float _tile_size;
+    float _load_radius;
+    float _evict_radius;
+
+    //objects whose payload was requested and not attached yet
+    std::set<size_t> _loading;
+
+    //objects whose payload is being written, they stay resident until the write succeeds
+    std::set<size_t> _writing;
+
+    //failed loads of each object
+    std::map<size_t,int> _load_failures;
+
+    //statistics
+    size_t _resident;
+    size_t _evicted;
+    size_t _evictions;
+    size_t _loads;
+
+    //I/O queue, the records read and the writes completed by the I/O thread
+    std::deque<Job> _jobs;
+    std::deque<Job> _loaded;
+    std::deque<Job> _written;
+    bool _running;
+    bool _busy;
+    std::mutex _mutex;
+    std::condition_variable _condition;
+    std::thread _thread;
+};
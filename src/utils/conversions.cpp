@@ -0,0 +1,59 @@
+#include "conversions.h"
+
+Eigen::Isometry3f tfTransform2eigen(const tf::Transform& p){
+  Eigen::Isometry3f iso;
+  iso.translation().x()=p.getOrigin().x();
+  iso.translation().y()=p.getOrigin().y();
+  iso.translation().z()=p.getOrigin().z();
+  Eigen::Quaternionf q;
+  tf::Quaternion tq = p.getRotation();
+  q.x()= tq.x();
+  q.y()= tq.y();
+  q.z()= tq.z();
+  q.w()= tq.w();
+  iso.linear()=q.toRotationMatrix();
+  return iso;
+}
+
+Eigen::Isometry3f poseMsg2eigen(const geometry_msgs::Pose& p){
+  Eigen::Isometry3f iso = Eigen::Isometry3f::Identity();
+  iso.translation().x()=p.position.x;
+  iso.translation().y()=p.position.y;
+  iso.translation().z()=p.position.z;
+  Eigen::Quaternionf q;
+  q.x()=p.orientation.x;
+  q.y()=p.orientation.y;
+  q.z()=p.orientation.z;
+  q.w()=p.orientation.w;
+  iso.linear()=q.toRotationMatrix();
+  return iso;
+}
+
+tf::Transform eigen2tfTransform(const Eigen::Isometry3f& T){
+  Eigen::Quaternionf q(T.linear());
+  Eigen::Vector3f t=T.translation();
+  tf::Transform tft;
+  tft.setOrigin(tf::Vector3(t.x(), t.y(), t.z()));
+  tft.setRotation(tf::Quaternion(q.x(), q.y(), q.z(), q.w()));
+  return tft;
+}
+
+void logicalImageToModels(const lucrezio_simulation_environments::LogicalImage::ConstPtr &logical_image_msg,
+                          ClassRegistry &registry,
+                          ModelVector &models){
+  int num_models = logical_image_msg->models.size();
+  models.resize(num_models);
+  tf::StampedTransform model_pose;
+  for(int i=0; i<num_models; ++i){
+    models[i].type() = logical_image_msg->models[i].type;
+    models[i].classId() = registry.intern(models[i].type());
+    models[i].min() = Eigen::Vector3f(logical_image_msg->models[i].min.x,
+                                      logical_image_msg->models[i].min.y,
+                                      logical_image_msg->models[i].min.z);
+    models[i].max() = Eigen::Vector3f(logical_image_msg->models[i].max.x,
+                                      logical_image_msg->models[i].max.y,
+                                      logical_image_msg->models[i].max.z);
+    tf::poseMsgToTF(logical_image_msg->models[i].pose,model_pose);
+    models[i].pose() = tfTransform2eigen(model_pose);
+  }
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+
+#include <tf/tf.h>
+#include <tf/transform_datatypes.h>
+#include <geometry_msgs/Pose.h>
+#include <lucrezio_simulation_environments/LogicalImage.h>
+
+#include <object_detector/model.h>
+#include <object_detector/class_registry.h>
+
+//conversions between ros messages and the internal types, shared by the node and the offline tools
+
+Eigen::Isometry3f tfTransform2eigen(const tf::Transform& p);
+
+Eigen::Isometry3f poseMsg2eigen(const geometry_msgs::Pose& p);
+
+tf::Transform eigen2tfTransform(const Eigen::Isometry3f& T);
+
+//extract models from logical image msg (class names are interned in the registry)
+void logicalImageToModels(const lucrezio_simulation_environments::LogicalImage::ConstPtr &logical_image_msg,
+                          ClassRegistry &registry,
+                          ModelVector &models);
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include <utility>
+#include <algorithm>
+
+//this class selects the pixels processed by a stage: every stride-th row and column,
+//optionally with a different stride per distance band (e.g. subsample near objects, keep far ones dense)
+class PixelSampler{
+  public:
+    PixelSampler(int stride_ = 1){setStride(stride_);}
+
+    //stride used below the first band
+    inline void setStride(int stride_){
+      _stride = std::max(stride_,1);
+      updateLimits();
+    }
+
+    //pyramid level l is equivalent to a stride of 2^l
+    inline void setPyramidLevel(int level){setStride(1 << level);}
+
+    //points at range >= min_range use the given stride (until the next band)
+    inline void addBand(float min_range, int stride_){
+      _bands.push_back(std::make_pair(min_range,std::max(stride_,1)));
+      std::sort(_bands.begin(),_bands.end());
+      updateLimits();
+    }
+
+    inline void clearBands(){
+      _bands.clear();
+      updateLimits();
+    }
+
+    //stride for a point at the given range
+    inline int stride(float range) const {
+      int s = _stride;
+      for(size_t i=0; i<_bands.size() && range >= _bands[i].first; ++i)
+        s = _bands[i].second;
+      return s;
+    }
+
+    //stride used to walk the image (smallest among all bands)
+    inline int minStride() const {return _min_stride;}
+
+    //true if all pixels are processed
+    inline bool dense() const {return _max_stride == 1;}
+
+    //true if pixel (r,c) at the given range is processed
+    inline bool keep(int r, int c, float range) const {
+      const int s = stride(range);
+      return !(r%s) && !(c%s);
+    }
+
+    inline bool hasBands() const {return !_bands.empty();}
+
+  private:
+    inline void updateLimits(){
+      _min_stride = _stride;
+      _max_stride = _stride;
+      for(size_t i=0; i<_bands.size(); ++i){
+        _min_stride = std::min(_min_stride,_bands[i].second);
+        _max_stride = std::max(_max_stride,_bands[i].second);
+      }
+    }
+
+    int _stride;
+    std::vector<std::pair<float,int> > _bands;
+    int _min_stride;
+    int _max_stride;
+};
@@ -0,0 +1,89 @@
+#include "profiler.h"
+
+#include <cmath>
+#include <algorithm>
+
+double getMonotonicTime(){
+  return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+LatencyHistogram::LatencyHistogram(){
+  for(int i=0; i<NUM_BUCKETS; ++i)
+    _buckets[i].store(0);
+  _sum_ns.store(0);
+  _max_ns.store(0);
+}
+
+int LatencyHistogram::bucketIndex(uint64_t ns){
+  if(ns < (1ull << MIN_EXPONENT))
+    return 0;
+  int exponent = 63 - __builtin_clzll(ns);
+  if(exponent > MAX_EXPONENT)
+    return NUM_BUCKETS-1;
+  int sub = (ns >> (exponent-SUB_BUCKETS_BITS)) & (SUB_BUCKETS-1);
+  return (exponent-MIN_EXPONENT)*SUB_BUCKETS + sub;
+}
+
+double LatencyHistogram::bucketValue(int index){
+  //center of the bucket, in seconds
+  int exponent = index/SUB_BUCKETS + MIN_EXPONENT;
+  int sub = index%SUB_BUCKETS;
+  double lower = std::ldexp(SUB_BUCKETS+sub,exponent-SUB_BUCKETS_BITS);
+  double width = std::ldexp(1.0,exponent-SUB_BUCKETS_BITS);
+  return (lower+width/2.0)*1e-9;
+}
+
+void LatencyHistogram::record(double seconds){
+  uint64_t ns = seconds > 0 ? static_cast<uint64_t>(seconds*1e9) : 0;
+  _buckets[bucketIndex(ns)].fetch_add(1,std::memory_order_relaxed);
+  _sum_ns.fetch_add(ns,std::memory_order_relaxed);
+
+  uint64_t max = _max_ns.load(std::memory_order_relaxed);
+  while(ns > max && !_max_ns.compare_exchange_weak(max,ns,std::memory_order_relaxed));
+}
+
+LatencyHistogram::Summary LatencyHistogram::makeSummary(const uint64_t *counts, uint64_t sum_ns, uint64_t max_ns){
+  Summary s;
+  for(int i=0; i<NUM_BUCKETS; ++i)
+    s.count += counts[i];
+  if(!s.count)
+    return s;
+
+  s.mean = sum_ns*1e-9/s.count;
+  s.max = max_ns*1e-9;
+
+  const uint64_t rank50 = std::ceil(0.50*s.count);
+  const uint64_t rank95 = std::ceil(0.95*s.count);
+  const uint64_t rank99 = std::ceil(0.99*s.count);
+  uint64_t cumulative = 0;
+  for(int i=0; i<NUM_BUCKETS; ++i){
+    if(!counts[i])
+      continue;
+    uint64_t previous = cumulative;
+    cumulative += counts[i];
+    double value = std::min(bucketValue(i),s.max);
+    if(previous < rank50 && cumulative >= rank50)
+      s.p50 = value;
+    if(previous < rank95 && cumulative >= rank95)
+      s.p95 = value;
+    if(previous < rank99 && cumulative >= rank99)
+      s.p99 = value;
+  }
+  return s;
+}
+
+LatencyHistogram::Summary LatencyHistogram::summary() const{
+  uint64_t counts[NUM_BUCKETS];
+  for(int i=0; i<NUM_BUCKETS; ++i)
+    counts[i] = _buckets[i].load(std::memory_order_relaxed);
+  return makeSummary(counts,_sum_ns.load(std::memory_order_relaxed),_max_ns.load(std::memory_order_relaxed));
+}
+
+LatencyHistogram::Summary LatencyHistogram::drain(){
+  uint64_t counts[NUM_BUCKETS];
+  for(int i=0; i<NUM_BUCKETS; ++i)
+    counts[i] = _buckets[i].exchange(0,std::memory_order_relaxed);
+  uint64_t sum_ns = _sum_ns.exchange(0,std::memory_order_relaxed);
+  uint64_t max_ns = _max_ns.exchange(0,std::memory_order_relaxed);
+  return makeSummary(counts,sum_ns,max_ns);
+}
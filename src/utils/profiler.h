@@ -0,0 +1,67 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+//seconds from a monotonic clock (not affected by system time changes)
+double getMonotonicTime();
+
+//this class records latencies in a lock-free log-linear histogram,
+//values are resolved with ~6% relative precision from 1us to ~2min
+class LatencyHistogram{
+  public:
+
+    struct Summary{
+      Summary():count(0),mean(0),p50(0),p95(0),p99(0),max(0){}
+      uint64_t count;
+      //latencies in seconds
+      double mean;
+      double p50;
+      double p95;
+      double p99;
+      double max;
+    };
+
+    LatencyHistogram();
+
+    //record a latency in seconds (safe to call concurrently)
+    void record(double seconds);
+
+    //statistics of the values recorded so far
+    Summary summary() const;
+
+    //statistics of the values recorded since the last drain, the histogram is emptied
+    Summary drain();
+
+  private:
+    static const int SUB_BUCKETS_BITS = 3;
+    static const int SUB_BUCKETS = 1 << SUB_BUCKETS_BITS;
+    static const int MIN_EXPONENT = 10; //2^10 ns ~ 1us
+    static const int MAX_EXPONENT = 37; //2^37 ns ~ 137s
+    static const int NUM_BUCKETS = (MAX_EXPONENT-MIN_EXPONENT+1)*SUB_BUCKETS;
+
+    static int bucketIndex(uint64_t ns);
+    static double bucketValue(int index);
+    static Summary makeSummary(const uint64_t *counts, uint64_t sum_ns, uint64_t max_ns);
+
+    std::atomic<uint64_t> _buckets[NUM_BUCKETS];
+    std::atomic<uint64_t> _sum_ns;
+    std::atomic<uint64_t> _max_ns;
+};
+
+//this class records the lifetime of a scope in a histogram
+class ScopedTimer{
+  public:
+    ScopedTimer(LatencyHistogram &histogram_):
+      _histogram(histogram_),
+      _start(std::chrono::steady_clock::now()){}
+
+    ~ScopedTimer(){
+      _histogram.record(std::chrono::duration<double>(std::chrono::steady_clock::now()-_start).count());
+    }
+
+  private:
+    LatencyHistogram &_histogram;
+    std::chrono::steady_clock::time_point _start;
+};
@@ -0,0 +1,115 @@
+#include "publish_scheduler.h"
+
+#include <chrono>
+#include <limits>
+#include <algorithm>
+
+#include "profiler.h"
+
+PublishScheduler::PublishScheduler(){
+  _frame = 0;
+  _running = false;
+}
+
+PublishScheduler::~PublishScheduler(){
+  stop();
+}
+
+void PublishScheduler::addTopic(const std::string &name,
+                                double rate,
+                                const SubscribedFunction &subscribed,
+                                const PublishFunction &publish){
+  Topic topic;
+  topic.name = name;
+  topic.period = rate > 0 ? 1.0/rate : 0.0;
+  topic.last_publish = -std::numeric_limits<double>::max();
+  topic.last_frame = 0;
+  topic.subscribed = subscribed;
+  topic.publish = publish;
+
+  std::lock_guard<std::mutex> lock(_mutex);
+  _topics.push_back(topic);
+}
+
+void PublishScheduler::start(){
+  std::lock_guard<std::mutex> lock(_mutex);
+  if(_running)
+    return;
+  _running = true;
+  _thread = std::thread(&PublishScheduler::run,this);
+}
+
+void PublishScheduler::stop(){
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if(!_running)
+      return;
+    _running = false;
+  }
+  _condition.notify_all();
+  _thread.join();
+}
+
+void PublishScheduler::notify(){
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _frame++;
+  }
+  _condition.notify_all();
+}
+
+bool PublishScheduler::due(const Topic &topic, double now) const{
+  return now-topic.last_publish >= topic.period;
+}
+
+bool PublishScheduler::wants(const std::string &name) const{
+  const double now = getMonotonicTime();
+  std::lock_guard<std::mutex> lock(_mutex);
+  for(const Topic &topic : _topics)
+    if(topic.name == name)
+      return due(topic,now) && topic.subscribed();
+  return false;
+}
+
+void PublishScheduler::run(){
+  std::unique_lock<std::mutex> lock(_mutex);
+  while(_running){
+
+    //wait for a new frame, or for the next topic with unpublished frames to become due
+    double now = getMonotonicTime();
+    bool pending = false;
+    double wait = std::numeric_limits<double>::max();
+    for(const Topic &topic : _topics){
+      if(topic.last_frame == _frame)
+        continue;
+      pending = true;
+      wait = std::min(wait,topic.last_publish+topic.period-now);
+    }
+    if(!pending)
+      _condition.wait(lock);
+    else if(wait > 0)
+      _condition.wait_for(lock,std::chrono::duration<double>(wait));
+    if(!_running)
+      break;
+
+    //publish the due topics without holding the lock
+    now = getMonotonicTime();
+    const uint64_t frame = _frame;
+    std::vector<size_t> due_topics;
+    for(size_t i=0; i<_topics.size(); ++i){
+      Topic &topic = _topics[i];
+      if(topic.last_frame == frame || !due(topic,now))
+        continue;
+      topic.last_frame = frame;
+      if(!topic.subscribed())
+        continue;
+      topic.last_publish = now;
+      due_topics.push_back(i);
+    }
+
+    lock.unlock();
+    for(size_t i : due_topics)
+      _topics[i].publish();
+    lock.lock();
+  }
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+
+//this class publishes output topics from a worker thread: after each new frame a topic is built
+//and published only when it is due according to its rate and somebody is subscribed
+class PublishScheduler{
+  public:
+    typedef std::function<bool()> SubscribedFunction;
+    typedef std::function<void()> PublishFunction;
+
+    PublishScheduler();
+
+    ~PublishScheduler();
+
+    //rate in Hz, a non-positive rate publishes every frame (topics are added before start)
+    void addTopic(const std::string &name,
+                  double rate,
+                  const SubscribedFunction &subscribed,
+                  const PublishFunction &publish);
+
+    void start();
+
+    void stop();
+
+    //signal that a new frame is available
+    void notify();
+
+    //true if the topic would be published for the next frame (used to capture per-frame inputs lazily)
+    bool wants(const std::string &name) const;
+
+  private:
+    struct Topic{
+      std::string name;
+      double period;
+      double last_publish;
+      uint64_t last_frame;
+      SubscribedFunction subscribed;
+      PublishFunction publish;
+    };
+
+    bool due(const Topic &topic, double now) const;
+
+    void run();
+
+    std::vector<Topic> _topics;
+
+    //frames notified so far
+    uint64_t _frame;
+
+    bool _running;
+    mutable std::mutex _mutex;
+    std::condition_variable _condition;
+    std::thread _thread;
+};
@@ -0,0 +1,128 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(int num_threads):
+  _task(0),
+  _remaining(0),
+  _active(0),
+  _generation(0),
+  _running(true){
+  num_threads = std::max(num_threads,1);
+  for(int i=0; i<num_threads; ++i)
+    _queues.push_back(std::unique_ptr<Queue>(new Queue()));
+
+  //the caller is worker 0
+  for(int i=1; i<num_threads; ++i)
+    _threads.push_back(std::thread(&ThreadPool::run,this,i));
+}
+
+ThreadPool::~ThreadPool(){
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _running = false;
+  }
+  _start_condition.notify_all();
+  for(std::thread &thread : _threads)
+    thread.join();
+}
+
+void ThreadPool::parallelFor(int n, const Task &task, int grain){
+  if(n <= 0)
+    return;
+  grain = std::max(grain,1);
+
+  std::unique_lock<std::mutex> loop_lock(_loop_mutex,std::try_to_lock);
+  if(_threads.empty() || n <= grain || !loop_lock.owns_lock()){
+    for(int i=0; i<n; ++i)
+      task(i,0);
+    return;
+  }
+
+  //deal the chunks round robin, contiguous chunks end up on different threads
+  int num_chunks = 0;
+  for(int begin=0; begin<n; begin+=grain, ++num_chunks){
+    Chunk chunk = {begin,std::min(begin+grain,n)};
+    Queue &queue = *_queues[num_chunks%_queues.size()];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    queue.chunks.push_back(chunk);
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _task = &task;
+    _remaining = num_chunks;
+    _generation++;
+  }
+  _start_condition.notify_all();
+
+  work(0,task);
+
+  //the task must outlive the workers that are still running it
+  std::unique_lock<std::mutex> lock(_mutex);
+  _done_condition.wait(lock,[this]{return _remaining == 0 && !_active;});
+  _task = 0;
+}
+
+bool ThreadPool::pop(int worker, Chunk &chunk){
+  Queue &queue = *_queues[worker];
+  std::lock_guard<std::mutex> lock(queue.mutex);
+  if(queue.chunks.empty())
+    return false;
+  chunk = queue.chunks.back();
+  queue.chunks.pop_back();
+  return true;
+}
+
+bool ThreadPool::steal(int worker, Chunk &chunk){
+  const int num_queues = _queues.size();
+  for(int k=1; k<num_queues; ++k){
+    Queue &queue = *_queues[(worker+k)%num_queues];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if(queue.chunks.empty())
+      continue;
+    chunk = queue.chunks.front();
+    queue.chunks.pop_front();
+    return true;
+  }
+  return false;
+}
+
+void ThreadPool::work(int worker, const Task &task){
+  Chunk chunk;
+  while(pop(worker,chunk) || steal(worker,chunk)){
+    for(int i=chunk.begin; i<chunk.end; ++i)
+      task(i,worker);
+
+    if(--_remaining == 0){
+      std::lock_guard<std::mutex> lock(_mutex);
+      _done_condition.notify_all();
+    }
+  }
+}
+
+void ThreadPool::run(int worker){
+  uint64_t generation = 0;
+  for(;;){
+    const Task *task;
+    {
+      std::unique_lock<std::mutex> lock(_mutex);
+      _start_condition.wait(lock,[this,generation]{return !_running || _generation != generation;});
+      if(!_running)
+        return;
+      generation = _generation;
+
+      //the loop may be over already
+      task = _task;
+      if(!task)
+        continue;
+      _active++;
+    }
+
+    work(worker,*task);
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    if(!--_active)
+      _done_condition.notify_all();
+  }
+}
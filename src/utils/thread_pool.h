@@ -0,0 +1,71 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+
+//this class runs the iterations of parallel loops on a fixed set of threads (work stealing):
+//a loop is split into chunks dealt to one deque per thread, each thread takes chunks from the back of
+//its own deque and, once it is empty, steals from the front of the others.
+//The calling thread takes part in the loop. A pool runs one loop at a time: a loop started while
+//another one is running (e.g. by another camera) runs serially on its caller
+class ThreadPool{
+  public:
+    //task(index, worker): worker in [0,size()) identifies the thread running the iteration
+    typedef std::function<void(int,int)> Task;
+
+    //num_threads includes the calling thread
+    ThreadPool(int num_threads);
+
+    ~ThreadPool();
+
+    //run task for the indices [0,n) in chunks of grain iterations and return when all are done
+    void parallelFor(int n, const Task &task, int grain = 1);
+
+    //setters and getters
+    inline int size() const {return _queues.size();}
+
+  private:
+    struct Chunk{
+      int begin;
+      int end;
+    };
+
+    struct Queue{
+      std::deque<Chunk> chunks;
+      std::mutex mutex;
+    };
+
+    //run chunks of the current loop as worker until there are none left
+    void work(int worker, const Task &task);
+
+    bool pop(int worker, Chunk &chunk);
+    bool steal(int worker, Chunk &chunk);
+
+    void run(int worker);
+
+    std::vector<std::unique_ptr<Queue> > _queues;
+    std::vector<std::thread> _threads;
+
+    //current loop
+    const Task *_task;
+    std::atomic<int> _remaining;
+    //workers running the current loop
+    int _active;
+    uint64_t _generation;
+    bool _running;
+    std::mutex _mutex;
+    std::condition_variable _start_condition;
+    std::condition_variable _done_condition;
+
+    //one loop at a time
+    std::mutex _loop_mutex;
+};
+
+typedef std::shared_ptr<ThreadPool> ThreadPoolPtr;